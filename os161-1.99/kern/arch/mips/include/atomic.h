@@ -0,0 +1,238 @@
+/*
+ * Copyright (c) 2000, 2001
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#ifndef _MIPS_ATOMIC_H_
+#define _MIPS_ATOMIC_H_
+
+/*
+ * MIPS atomic operations; see <atomic.h>. Built on LL/SC like
+ * spinlock_data_testandset, except that they retry until the SC
+ * succeeds. Pointers are 32 bits, so the pointer versions are the
+ * word versions with casts.
+ */
+
+#include <cdefs.h>
+
+unsigned atomic_load(const volatile unsigned *p);
+void atomic_store(volatile unsigned *p, unsigned val);
+unsigned atomic_cas(volatile unsigned *p, unsigned old, unsigned newval);
+unsigned atomic_swap(volatile unsigned *p, unsigned newval);
+unsigned atomic_fetchadd(volatile unsigned *p, unsigned delta);
+unsigned atomic_inc(volatile unsigned *p);
+unsigned atomic_dec(volatile unsigned *p);
+
+void *atomic_loadptr(void *const volatile *p);
+void atomic_storeptr(void *volatile *p, void *val);
+void *atomic_casptr(void *volatile *p, void *old, void *newval);
+void *atomic_swapptr(void *volatile *p, void *newval);
+
+void membar_producer(void);
+void membar_consumer(void);
+void membar_any_any(void);
+
+////////////////////////////////////////////////////////////
+
+ATOMIC_INLINE
+unsigned
+atomic_load(const volatile unsigned *p)
+{
+	return *p;
+}
+
+ATOMIC_INLINE
+void
+atomic_store(volatile unsigned *p, unsigned val)
+{
+	*p = val;
+}
+
+ATOMIC_INLINE
+unsigned
+atomic_cas(volatile unsigned *p, unsigned old, unsigned newval)
+{
+	unsigned x;
+	unsigned y;
+
+	/*
+	 * Compare-and-swap using LL/SC.
+	 *
+	 * Load the existing value into X; if it isn't OLD, stop.
+	 * Otherwise try to store NEWVAL (via Y, which the SC sets to
+	 * 1 on success and 0 on failure) and start over if the SC
+	 * failed. Returns X.
+	 */
+
+	__asm volatile(
+		".set push;"		/* save assembler mode */
+		".set mips32;"		/* allow MIPS32 instructions */
+		".set volatile;"	/* avoid unwanted optimization */
+		"1: ll %0, 0(%2);"	/*   x = *p */
+		"bne %0, %3, 2f;"	/*   give up if x != old */
+		"move %1, %4;"		/*   y = newval */
+		"sc %1, 0(%2);"		/*   *p = y; y = success? */
+		"beqz %1, 1b;"		/*   retry if the store failed */
+		"2:"
+		".set pop"		/* restore assembler mode */
+		: "=&r" (x), "=&r" (y)
+		: "r" (p), "r" (old), "r" (newval)
+		: "memory");
+	return x;
+}
+
+ATOMIC_INLINE
+unsigned
+atomic_swap(volatile unsigned *p, unsigned newval)
+{
+	unsigned x;
+	unsigned y;
+
+	/*
+	 * Swap using LL/SC: load the old value into X and store
+	 * NEWVAL, retrying until the SC succeeds.
+	 */
+
+	__asm volatile(
+		".set push;"		/* save assembler mode */
+		".set mips32;"		/* allow MIPS32 instructions */
+		".set volatile;"	/* avoid unwanted optimization */
+		"1: ll %0, 0(%2);"	/*   x = *p */
+		"move %1, %3;"		/*   y = newval */
+		"sc %1, 0(%2);"		/*   *p = y; y = success? */
+		"beqz %1, 1b;"		/*   retry if the store failed */
+		".set pop"		/* restore assembler mode */
+		: "=&r" (x), "=&r" (y)
+		: "r" (p), "r" (newval)
+		: "memory");
+	return x;
+}
+
+ATOMIC_INLINE
+unsigned
+atomic_fetchadd(volatile unsigned *p, unsigned delta)
+{
+	unsigned x;
+	unsigned y;
+
+	/*
+	 * Fetch-and-add using LL/SC: load the old value into X, store
+	 * X + DELTA, and retry until the SC succeeds.
+	 */
+
+	__asm volatile(
+		".set push;"		/* save assembler mode */
+		".set mips32;"		/* allow MIPS32 instructions */
+		".set volatile;"	/* avoid unwanted optimization */
+		"1: ll %0, 0(%2);"	/*   x = *p */
+		"addu %1, %0, %3;"	/*   y = x + delta */
+		"sc %1, 0(%2);"		/*   *p = y; y = success? */
+		"beqz %1, 1b;"		/*   retry if the store failed */
+		".set pop"		/* restore assembler mode */
+		: "=&r" (x), "=&r" (y)
+		: "r" (p), "r" (delta)
+		: "memory");
+	return x;
+}
+
+ATOMIC_INLINE
+unsigned
+atomic_inc(volatile unsigned *p)
+{
+	return atomic_fetchadd(p, 1) + 1;
+}
+
+ATOMIC_INLINE
+unsigned
+atomic_dec(volatile unsigned *p)
+{
+	return atomic_fetchadd(p, (unsigned)-1) - 1;
+}
+
+ATOMIC_INLINE
+void *
+atomic_loadptr(void *const volatile *p)
+{
+	return *p;
+}
+
+ATOMIC_INLINE
+void
+atomic_storeptr(void *volatile *p, void *val)
+{
+	*p = val;
+}
+
+ATOMIC_INLINE
+void *
+atomic_casptr(void *volatile *p, void *old, void *newval)
+{
+	return (void *)atomic_cas((volatile unsigned *)p,
+				  (unsigned)old, (unsigned)newval);
+}
+
+ATOMIC_INLINE
+void *
+atomic_swapptr(void *volatile *p, void *newval)
+{
+	return (void *)atomic_swap((volatile unsigned *)p,
+				   (unsigned)newval);
+}
+
+/*
+ * System/161 processors don't reorder memory accesses, but SYNC
+ * costs little there and keeps this correct on hardware that does.
+ * All three barriers are the same full barrier.
+ */
+ATOMIC_INLINE
+void
+membar_any_any(void)
+{
+	__asm volatile(
+		".set push;"		/* save assembler mode */
+		".set mips32;"		/* allow MIPS32 instructions */
+		"sync;"			/* do it */
+		".set pop"		/* restore assembler mode */
+		::: "memory");
+}
+
+ATOMIC_INLINE
+void
+membar_producer(void)
+{
+	membar_any_any();
+}
+
+ATOMIC_INLINE
+void
+membar_consumer(void)
+{
+	membar_any_any();
+}
+
+
+#endif /* _MIPS_ATOMIC_H_ */
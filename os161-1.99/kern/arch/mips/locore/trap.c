@@ -36,10 +36,12 @@
 #include <spl.h>
 #include <thread.h>
 #include <current.h>
+#include <proc.h>
 #include <vm.h>
 #include <mainbus.h>
 #include <syscall.h>
 
+#include "opt-A2.h"
 #include "opt-A3.h"
 
 
@@ -157,6 +159,7 @@ void mips_trap(struct trapframe *tf) {
 
 		old_in = curthread->t_in_interrupt;
 		curthread->t_in_interrupt = 1;
+		curcpu->c_interrupts++;
 
 		/*
 		 * The processor has turned interrupts off; if the
@@ -196,6 +199,20 @@ void mips_trap(struct trapframe *tf) {
 		}
 
 		curthread->t_in_interrupt = old_in;
+
+		#if OPT_A2
+			/*
+			 * Don't go back to user mode in a process that's
+			 * exiting; this is what gets threads that never make
+			 * a system call. Turn interrupts back on first, as
+			 * for a syscall (the stored state is low here).
+			 */
+			if (!iskern && curproc->p_exiting) {
+				spl = splhigh();
+				splx(spl);
+				proc_exitcheck();
+			}
+		#endif
 		goto done2;
 	}
 
@@ -429,3 +446,23 @@ void enter_new_process(int argc, userptr_t argv, vaddr_t stack, vaddr_t entry) {
 
 	mips_usermode(&tf);
 }
+
+/*
+ * enter_user_thread: go to user mode in a thread made by
+ * thread_create, running ENTRY(ARG) with its stack pointer at STACK,
+ * which the caller has already set 16 bytes below the top of the
+ * user's stack for the o32 argument area. There is nothing to
+ * return to (ra is 0); the thread must call thread_exit.
+ */
+void enter_user_thread(vaddr_t entry, vaddr_t arg, vaddr_t stack) {
+	struct trapframe tf;
+
+	bzero(&tf, sizeof(tf));
+
+	tf.tf_status = CST_IRQMASK | CST_IEp | CST_KUp;
+	tf.tf_epc = entry;
+	tf.tf_a0 = arg;
+	tf.tf_sp = stack;
+
+	mips_usermode(&tf);
+}
@@ -35,6 +35,7 @@
 #include <thread.h>
 #include <current.h>
 #include <syscall.h>
+#include <copyinout.h>
 
 #include "opt-A2.h"
 
@@ -81,6 +82,11 @@ void syscall(struct trapframe *tf) {
 	int callno;
 	int32_t retval;
 	int err;
+	#if OPT_A2
+		off_t retval64;
+		bool is64;
+		int whence;
+	#endif
 
 	KASSERT(curthread != NULL);
 	KASSERT(curthread->t_curspl == 0);
@@ -98,6 +104,11 @@ void syscall(struct trapframe *tf) {
 	 */
 
 	retval = 0;
+	#if OPT_A2
+		/* set for calls that return 64 bits, in v0 and v1 */
+		retval64 = 0;
+		is64 = false;
+	#endif
 
 	switch (callno) {
 	    case SYS_reboot:
@@ -108,6 +119,17 @@ void syscall(struct trapframe *tf) {
 			err = sys___time((userptr_t)tf->tf_a0,
 							 (userptr_t)tf->tf_a1);
 			break;
+
+	    case SYS_futex_wait:
+			err = sys_futex_wait((userptr_t)tf->tf_a0,
+					     (uint32_t)tf->tf_a1);
+			break;
+
+	    case SYS_futex_wake:
+			err = sys_futex_wake((userptr_t)tf->tf_a0,
+					     (int)tf->tf_a1,
+					     (int *)&retval);
+			break;
 #ifdef UW
 	case SYS_write:
 	  err = sys_write((int)tf->tf_a0,
@@ -144,6 +166,62 @@ void syscall(struct trapframe *tf) {
 				err = sys_execv((char *)tf->tf_a0, (char **)tf->tf_a1);
 				break;
 		#endif
+		#if OPT_A2
+			case SYS_open:
+				err = sys_open((userptr_t)tf->tf_a0,
+					       (int)tf->tf_a1,
+					       (mode_t)tf->tf_a2,
+					       (int *)&retval);
+				break;
+			case SYS_read:
+				err = sys_read((int)tf->tf_a0,
+					       (userptr_t)tf->tf_a1,
+					       (int)tf->tf_a2,
+					       (int *)&retval);
+				break;
+			case SYS_lseek:
+				/*
+				 * The 64-bit offset is in a2/a3 (a1 is
+				 * padding, for alignment); whence is
+				 * on the user stack.
+				 */
+				err = copyin((userptr_t)(tf->tf_sp + 16),
+					     &whence, sizeof(whence));
+				if (err) {
+					break;
+				}
+				err = sys_lseek((int)tf->tf_a0,
+						((off_t)tf->tf_a2 << 32) |
+						tf->tf_a3,
+						whence, &retval64);
+				is64 = true;
+				break;
+			case SYS_close:
+				err = sys_close((int)tf->tf_a0);
+				break;
+			case SYS_dup2:
+				err = sys_dup2((int)tf->tf_a0,
+					       (int)tf->tf_a1,
+					       (int *)&retval);
+				break;
+		#endif
+		#if OPT_A2
+			case SYS_thread_create:
+				err = sys_thread_create((userptr_t)tf->tf_a0,
+							(userptr_t)tf->tf_a1,
+							(userptr_t)tf->tf_a2,
+							(int *)&retval);
+				break;
+			case SYS_thread_exit:
+				sys_thread_exit((int)tf->tf_a0);
+				/* sys_thread_exit does not return */
+				panic("unexpected return from sys_thread_exit");
+				break;
+			case SYS_thread_join:
+				err = sys_thread_join((int)tf->tf_a0,
+						      (userptr_t)tf->tf_a1);
+				break;
+		#endif
 
 	default:
 	  kprintf("Unknown syscall %d\n", callno);
@@ -161,6 +239,14 @@ void syscall(struct trapframe *tf) {
 		tf->tf_v0 = err;
 		tf->tf_a3 = 1;      /* signal an error */
 	}
+	#if OPT_A2
+	else if (is64) {
+		/* Success, with a 64-bit value: high word in v0. */
+		tf->tf_v0 = (uint32_t)(retval64 >> 32);
+		tf->tf_v1 = (uint32_t)retval64;
+		tf->tf_a3 = 0;      /* signal no error */
+	}
+	#endif
 	else {
 		/* Success. */
 		tf->tf_v0 = retval;
@@ -178,6 +264,11 @@ void syscall(struct trapframe *tf) {
 	KASSERT(curthread->t_curspl == 0);
 	/* ...or leak any spinlocks */
 	KASSERT(curthread->t_iplhigh_count == 0);
+
+	#if OPT_A2
+		/* Another thread may have called _exit meanwhile */
+		proc_exitcheck();
+	#endif
 }
 
 /*
@@ -68,7 +68,7 @@
 /*
  * Wrap rma_stealmem in a spinlock.
  */
-static struct spinlock stealmem_lock = SPINLOCK_INITIALIZER;
+static struct spinlock stealmem_lock = SPINLOCK_NAMED_INITIALIZER("stealmem");
 
 void vm_bootstrap(void) {
 	#if OPT_A3
@@ -274,13 +274,85 @@ void vm_tlbshootdown(const struct tlbshootdown *ts) {
 	panic("dumbvm tried to do tlb shootdown?!\n");
 }
 
-int vm_fault(int faulttype, vaddr_t faultaddress) {
+/*
+ * Find the physical page that user page VPAGE of AS is mapped to.
+ * Returns EFAULT if it isn't in any region. This is the lookup
+ * vm_fault loads into the TLB, so anything else that needs a user
+ * page's physical address must use it too.
+ */
+static int dumbvm_lookup(struct addrspace *as, vaddr_t vpage, paddr_t *ret) {
 	vaddr_t vbase1, vtop1, vbase2, vtop2, stackbase, stacktop;
 	paddr_t paddr;
+
+	KASSERT((vpage & PAGE_FRAME) == vpage);
+
+	vbase1 = as->as_vbase1;
+	vtop1 = vbase1 + as->as_npages1 * PAGE_SIZE;
+	vbase2 = as->as_vbase2;
+	vtop2 = vbase2 + as->as_npages2 * PAGE_SIZE;
+	stackbase = USERSTACK - DUMBVM_STACKPAGES * PAGE_SIZE;
+	stacktop = USERSTACK;
+
+	#if OPT_A3
+		if (vpage >= vbase1 && vpage < vtop1) {
+			paddr = (vpage - vbase1) + as->as_pbase1[0];
+		}
+		else if (vpage >= vbase2 && vpage < vtop2) {
+			paddr = (vpage - vbase2) + as->as_pbase2[0];
+		}
+		else if (vpage >= stackbase && vpage < stacktop) {
+			paddr = (vpage - stackbase) + as->as_stackpbase[0];
+		}
+		else {
+			return EFAULT;
+		}
+	#else
+		if (vpage >= vbase1 && vpage < vtop1) {
+			paddr = (vpage - vbase1) + as->as_pbase1;
+		}
+		else if (vpage >= vbase2 && vpage < vtop2) {
+			paddr = (vpage - vbase2) + as->as_pbase2;
+		}
+		else if (vpage >= stackbase && vpage < stacktop) {
+			paddr = (vpage - stackbase) + as->as_stackpbase;
+		}
+		else {
+			return EFAULT;
+		}
+	#endif
+
+	*ret = paddr;
+	return 0;
+}
+
+int vm_translate(vaddr_t vaddr, paddr_t *ret) {
+	struct addrspace *as;
+	paddr_t paddr;
+	int result;
+
+	if (curproc == NULL) {
+		return EFAULT;
+	}
+	as = curproc_getas();
+	if (as == NULL || vaddr >= USERSPACETOP) {
+		return EFAULT;
+	}
+
+	result = dumbvm_lookup(as, vaddr & PAGE_FRAME, &paddr);
+	if (result) {
+		return result;
+	}
+	*ret = paddr + (vaddr & ~PAGE_FRAME);
+	return 0;
+}
+
+int vm_fault(int faulttype, vaddr_t faultaddress) {
+	paddr_t paddr;
 	int i;
 	uint32_t ehi, elo;
 	struct addrspace *as;
 	int spl;
+	int result;
 
 	faultaddress &= PAGE_FRAME;
 
@@ -345,43 +417,13 @@ int vm_fault(int faulttype, vaddr_t faultaddress) {
 		KASSERT((as->as_stackpbase & PAGE_FRAME) == as->as_stackpbase);
 	#endif
 
-	vbase1 = as->as_vbase1;
-	vtop1 = vbase1 + as->as_npages1 * PAGE_SIZE;
-	vbase2 = as->as_vbase2;
-	vtop2 = vbase2 + as->as_npages2 * PAGE_SIZE;
-	stackbase = USERSTACK - DUMBVM_STACKPAGES * PAGE_SIZE;
-	stacktop = USERSTACK;
-
+	result = dumbvm_lookup(as, faultaddress, &paddr);
+	if (result) {
+		return result;
+	}
 	#if OPT_A3
-		bool is_code;
-		if (faultaddress >= vbase1 && faultaddress < vtop1) {
-			paddr = (faultaddress - vbase1) + as->as_pbase1[0];
-			is_code = true;
-		}
-		else if (faultaddress >= vbase2 && faultaddress < vtop2) {
-			paddr = (faultaddress - vbase2) + as->as_pbase2[0];
-			is_code = false;
-		}
-		else if (faultaddress >= stackbase && faultaddress < stacktop) {
-			paddr = (faultaddress - stackbase) + as->as_stackpbase[0];
-			is_code = false;
-		}
-		else {
-			return EFAULT;
-		}
-	#else
-		if (faultaddress >= vbase1 && faultaddress < vtop1) {
-			paddr = (faultaddress - vbase1) + as->as_pbase1;
-		}
-		else if (faultaddress >= vbase2 && faultaddress < vtop2) {
-			paddr = (faultaddress - vbase2) + as->as_pbase2;
-		}
-		else if (faultaddress >= stackbase && faultaddress < stacktop) {
-			paddr = (faultaddress - stackbase) + as->as_stackpbase;
-		}
-		else {
-			return EFAULT;
-		}
+		bool is_code = faultaddress >= as->as_vbase1 &&
+			faultaddress < as->as_vbase1 + as->as_npages1 * PAGE_SIZE;
 	#endif
 
 	/* make sure it's page-aligned */
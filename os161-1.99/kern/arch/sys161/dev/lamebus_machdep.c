@@ -242,6 +242,27 @@ mainbus_send_ipi(struct cpu *target)
 	lamebus_assert_ipi(lamebus, target);
 }
 
+/*
+ * Hardclock on/off. "Off" is a slow tick, IDLE_HZ times a second,
+ * rather than the longest countdown there is (2^32 cycles, close to
+ * three minutes): each tick sends the idle loop back to look at its
+ * run queues, so work whose IPI never arrived waits at most that
+ * long instead of minutes.
+ */
+#define IDLE_HZ  10
+
+void
+mainbus_hardclock_stop(void)
+{
+	mips_timer_set(CPU_FREQUENCY / IDLE_HZ);
+}
+
+void
+mainbus_hardclock_start(void)
+{
+	mips_timer_set(CPU_FREQUENCY / HZ);
+}
+
 /*
  * Interrupt dispatcher.
  */
@@ -264,8 +285,24 @@ mainbus_interrupt(struct trapframe *tf)
 		lamebus_interrupt(lamebus);
 	}
 	else if (cause & LAMEBUS_IPI_BIT) {
-		interprocessor_interrupt();
+		/*
+		 * Clear the IPI before collecting the pending bits, not
+		 * after: ipi_post only raises it when nothing is pending,
+		 * so one posted in between would be wiped by the clear
+		 * and this cpu would never be interrupted again. A post
+		 * after the clear is either collected below or raises
+		 * the IPI again, which at worst is a trap that finds
+		 * nothing to do.
+		 */
 		lamebus_clear_ipi(lamebus, curcpu);
+		if (interprocessor_interrupt()) {
+			/*
+			 * IPI_PREEMPT. Yield only now, with the IPI
+			 * acknowledged, as for the timer below: this
+			 * thread may not run again for a while.
+			 */
+			thread_yield();
+		}
 	}
 	else if (cause & MIPS_TIMER_BIT) {
 		/* Reset the timer (this clears the interrupt) */
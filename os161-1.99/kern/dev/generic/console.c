@@ -58,9 +58,14 @@
 #include <current.h>
 #include <synch.h>
 #include <generic/console.h>
+#include <atomic.h>
 #include <vfs.h>
 #include <device.h>
 #include "autoconf.h"
+#include "opt-A2.h"
+#if OPT_A2
+#include <proc.h>
+#endif
 
 /*
  * The console device.
@@ -74,6 +79,16 @@ static struct con_softc *the_console = NULL;
 static struct lock *con_userlock_read = NULL;
 static struct lock *con_userlock_write = NULL;
 
+/*
+ * Lock for the writer side of a buffered device (one with
+ * cs_sendbuf). With one writer at a time there's at most one thread
+ * waiting for room, which is what con_start assumes.
+ */
+static struct lock *con_txlock = NULL;
+
+/* Size of the pieces con_io copies user output in */
+#define CON_CHUNKSIZE  128
+
 //////////////////////////////////////////////////
 
 /*
@@ -153,16 +168,51 @@ putch_intr(struct con_softc *cs, int ch)
 	cs->cs_send(cs->cs_devdata, ch);
 }
 
+/*
+ * Print LEN characters through the device's transmit buffer. Only
+ * waits if the buffer fills up; the device drains it by itself.
+ */
+static
+void
+putbuf_intr(struct con_softc *cs, const char *buf, size_t len)
+{
+	size_t n;
+
+	if (len == 0) {
+		return;
+	}
+	lock_acquire(con_txlock);
+	while (len > 0) {
+		n = cs->cs_sendbuf(cs->cs_devdata, buf, len);
+		buf += n;
+		len -= n;
+		if (len > 0) {
+			P(cs->cs_wsem);
+		}
+	}
+	lock_release(con_txlock);
+}
+
 /*
  * Read a character, using interrupts to wait for I/O completion.
+ * Returns -1 if woken by getch_interrupt instead.
  */
 static
 int
 getch_intr(struct con_softc *cs)
 {
 	unsigned char ret;
+	unsigned n, seen;
 
 	P(cs->cs_rsem);
+	n = atomic_load(&cs->cs_rinterrupts);
+	while (n > 0) {
+		seen = atomic_cas(&cs->cs_rinterrupts, n, n - 1);
+		if (seen == n) {
+			return -1;
+		}
+		n = seen;
+	}
 	ret = cs->cs_gotchars[cs->cs_gotchars_tail];
 	cs->cs_gotchars_tail =
 		(cs->cs_gotchars_tail + 1) % CONSOLE_INPUT_BUFFER_SIZE;
@@ -228,11 +278,37 @@ putch(int ch)
 	else if (curthread->t_in_interrupt || curthread->t_iplhigh_count > 0) {
 		putch_polled(cs, ch);
 	}
+	else if (cs->cs_sendbuf != NULL) {
+		char c = ch;
+
+		putbuf_intr(cs, &c, 1);
+	}
 	else {
 		putch_intr(cs, ch);
 	}
 }
 
+/*
+ * Print LEN characters; like calling putch on each, but in bulk if
+ * the device allows and we can sleep.
+ */
+void
+putbuf(const char *buf, size_t len)
+{
+	struct con_softc *cs = the_console;
+	size_t i;
+
+	if (cs != NULL && cs->cs_sendbuf != NULL &&
+	    !curthread->t_in_interrupt && curthread->t_iplhigh_count == 0) {
+		putbuf_intr(cs, buf, len);
+	}
+	else {
+		for (i=0; i<len; i++) {
+			putch(buf[i]);
+		}
+	}
+}
+
 void
 putch_prepare(void)
 {
@@ -269,10 +345,32 @@ int
 getch(void)
 {
 	struct con_softc *cs = the_console;
+	int ch;
+
 	KASSERT(cs != NULL);
 	KASSERT(!curthread->t_in_interrupt && curthread->t_iplhigh_count == 0);
 
-	return getch_intr(cs);
+	do {
+		ch = getch_intr(cs);
+	} while (ch < 0);
+	return ch;
+}
+
+/*
+ * Wake whoever is sleeping in getch_intr. The reader holds
+ * con_userlock_read, so there is at most one; if it isn't the one
+ * that should stop, it just goes back to sleep.
+ */
+void
+getch_interrupt(void)
+{
+	struct con_softc *cs = the_console;
+
+	if (cs == NULL) {
+		return;
+	}
+	atomic_inc(&cs->cs_rinterrupts);
+	V(cs->cs_rsem);
 }
 
 ////////////////////////////////////////////////////////////
@@ -298,6 +396,41 @@ con_close(struct device *dev)
 	return 0;
 }
 
+/*
+ * Write out a user buffer. It's copied in CON_CHUNKSIZE bytes at a
+ * time and each chunk is printed in runs between newlines, which
+ * get a carriage return in front.
+ */
+static
+int
+con_write(struct uio *uio)
+{
+	char buf[CON_CHUNKSIZE];
+	size_t len, start, i;
+	int result;
+
+	while (uio->uio_resid > 0) {
+		len = uio->uio_resid;
+		if (len > sizeof(buf)) {
+			len = sizeof(buf);
+		}
+		result = uiomove(buf, len, uio);
+		if (result) {
+			return result;
+		}
+		start = 0;
+		for (i=0; i<len; i++) {
+			if (buf[i] == '\n') {
+				putbuf(buf + start, i - start);
+				putbuf("\r", 1);
+				start = i;
+			}
+		}
+		putbuf(buf + start, len - start);
+	}
+	return 0;
+}
+
 static
 int
 con_io(struct device *dev, struct uio *uio)
@@ -318,31 +451,36 @@ con_io(struct device *dev, struct uio *uio)
 	KASSERT(lk != NULL);
 	lock_acquire(lk);
 
+	if (uio->uio_rw==UIO_WRITE) {
+		result = con_write(uio);
+		lock_release(lk);
+		return result;
+	}
+
 	while (uio->uio_resid > 0) {
-		if (uio->uio_rw==UIO_READ) {
-			ch = getch();
-			if (ch=='\r') {
-				ch = '\n';
-			}
-			result = uiomove(&ch, 1, uio);
-			if (result) {
-				lock_release(lk);
-				return result;
-			}
-			if (ch=='\n') {
-				break;
-			}
+#if OPT_A2
+		/* another thread called _exit; let this one leave too */
+		if (curproc != NULL && curproc->p_exiting) {
+			lock_release(lk);
+			return EINTR;
 		}
-		else {
-			result = uiomove(&ch, 1, uio);
-			if (result) {
-				lock_release(lk);
-				return result;
-			}
-			if (ch=='\n') {
-				putch('\r');
-			}
-			putch(ch);
+#endif
+		result = getch_intr(the_console);
+		if (result < 0) {
+			/* getch_interrupt; recheck */
+			continue;
+		}
+		ch = result;
+		if (ch=='\r') {
+			ch = '\n';
+		}
+		result = uiomove(&ch, 1, uio);
+		if (result) {
+			lock_release(lk);
+			return result;
+		}
+		if (ch=='\n') {
+			break;
 		}
 	}
 	lock_release(lk);
@@ -399,7 +537,7 @@ int
 config_con(struct con_softc *cs, int unit)
 {
 	struct semaphore *rsem, *wsem;
-	struct lock *rlk, *wlk;
+	struct lock *rlk, *wlk, *txlk;
 
 	/*
 	 * Only allow one system console.
@@ -418,7 +556,8 @@ config_con(struct con_softc *cs, int unit)
 	if (rsem == NULL) {
 		return ENOMEM;
 	}
-	wsem = sem_create("console write", 1);
+	/* buffered devices only signal when a writer is waiting */
+	wsem = sem_create("console write", cs->cs_sendbuf != NULL ? 0 : 1);
 	if (wsem == NULL) {
 		sem_destroy(rsem);
 		return ENOMEM;
@@ -436,15 +575,25 @@ config_con(struct con_softc *cs, int unit)
 		sem_destroy(wsem);
 		return ENOMEM;
 	}
+	txlk = lock_create("console-lock-tx");
+	if (txlk == NULL) {
+		lock_destroy(wlk);
+		lock_destroy(rlk);
+		sem_destroy(rsem);
+		sem_destroy(wsem);
+		return ENOMEM;
+	}
 
 	cs->cs_rsem = rsem; 
 	cs->cs_wsem = wsem; 
 	cs->cs_gotchars_head = 0;
 	cs->cs_gotchars_tail = 0;
+	cs->cs_rinterrupts = 0;
 
 	the_console = cs;
 	con_userlock_read = rlk;
 	con_userlock_write = wlk;
+	con_txlock = txlk;
 
 	flush_delay_buf();
 
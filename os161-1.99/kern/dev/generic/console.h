@@ -35,6 +35,12 @@
  *
  * devdata, send, and sendpolled are provided by the underlying
  * device, and are to be initialized by the attach routine.
+ *
+ * sendbuf is optional. If the device has one, output that isn't
+ * polled goes through it instead of send: it queues up to LEN
+ * characters and returns how many it took, and if that's short the
+ * device calls con_start once there's room. Otherwise con_start is
+ * called after each character given to send.
  */
 
 #define CONSOLE_INPUT_BUFFER_SIZE 32
@@ -43,6 +49,7 @@ struct con_softc {
 	/* initialized by attach routine */
 	void *cs_devdata;
 	void (*cs_send)(void *devdata, int ch);
+	size_t (*cs_sendbuf)(void *devdata, const char *buf, size_t len);
 	void (*cs_sendpolled)(void *devdata, int ch);
 	void (*cs_startpolling)(void *devdata);
 	void (*cs_endpolling)(void *devdata);
@@ -53,6 +60,7 @@ struct con_softc {
 	unsigned char cs_gotchars[CONSOLE_INPUT_BUFFER_SIZE];
 	unsigned cs_gotchars_head;	/* next slot to put a char in */
 	unsigned cs_gotchars_tail;	/* next slot to take a char out */
+	volatile unsigned cs_rinterrupts; /* getch_interrupt wakeups */
 };
 
 /*
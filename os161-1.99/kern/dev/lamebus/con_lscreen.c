@@ -48,6 +48,7 @@ attach_con_to_lscreen(int consno, struct lscreen_softc *ls)
 
 	cs->cs_devdata = ls;
 	cs->cs_send = lscreen_write;
+	cs->cs_sendbuf = NULL;
 	cs->cs_sendpolled = lscreen_write;
 	cs->cs_startpolling = NULL;
 	cs->cs_endpolling = NULL;
@@ -46,6 +46,7 @@
 #include <stat.h>
 #include <lib.h>
 #include <array.h>
+#include <atomic.h>
 #include <uio.h>
 #include <synch.h>
 #include <lamebus/emu.h>
@@ -479,7 +480,9 @@ emufs_reclaim(struct vnode *v)
 	vfs_biglock_acquire();
 	lock_acquire(ef->ef_emu->e_lock);
 
-	if (ev->ev_v.vn_refcount != 1) {
+	if (atomic_load(&ev->ev_v.vn_refcount) != 1) {
+		/* consume the reference VOP_DECREF gave us */
+		atomic_dec(&ev->ev_v.vn_refcount);
 		lock_release(ef->ef_emu->e_lock);
 		vfs_biglock_release();
 		return EBUSY;
@@ -51,6 +51,7 @@ lser_irq(void *vsc)
 	bool clear_to_write = false;
 	bool got_a_read = false;
 	uint32_t ch = 0;
+	char txch;
 
 	spinlock_acquire(&sc->ls_lock);
 
@@ -58,9 +59,31 @@ lser_irq(void *vsc)
 	if (x & LSER_IRQ_ACTIVE) {
 		x = LSER_IRQ_ENABLE;
 		sc->ls_wbusy = 0;
-		clear_to_write = true;
 		bus_write_register(sc->ls_busdata, sc->ls_buspos,
 				   LSER_REG_WIRQ, x);
+
+		if (sc->ls_txsingle) {
+			/* lser_write's caller waits for every character */
+			sc->ls_txsingle = false;
+			clear_to_write = true;
+		}
+		else if (spscring_read(&sc->ls_txring, &txch, 1) == 1) {
+			/* keep the buffer draining */
+			sc->ls_wbusy = true;
+			bus_write_register(sc->ls_busdata, sc->ls_buspos,
+					   LSER_REG_CHAR, (unsigned char)txch);
+		}
+
+		/*
+		 * Wake a waiting lser_writebuf caller only once half
+		 * the buffer is free, so it refills in bulk rather
+		 * than one character per interrupt.
+		 */
+		if (sc->ls_txwaiting &&
+		    spscring_space(&sc->ls_txring) >= LSER_TXBUFSIZE / 2) {
+			sc->ls_txwaiting = false;
+			clear_to_write = true;
+		}
 	}
 
 	x = bus_read_register(sc->ls_busdata, sc->ls_buspos, LSER_REG_RIRQ);
@@ -105,12 +128,38 @@ lser_write(void *vls, int ch)
 		panic("lser: Not clear to write\n");
 	}
 	ls->ls_wbusy = true;
+	ls->ls_txsingle = true;
 
 	bus_write_register(ls->ls_busdata, ls->ls_buspos, LSER_REG_CHAR, ch);
 
 	spinlock_release(&ls->ls_lock);
 }
 
+size_t
+lser_writebuf(void *vls, const char *buf, size_t len)
+{
+	struct lser_softc *ls = vls;
+	size_t n;
+	char ch;
+
+	spinlock_acquire(&ls->ls_lock);
+
+	n = spscring_write(&ls->ls_txring, buf, len);
+	if (n < len) {
+		ls->ls_txwaiting = true;
+	}
+
+	/* If the device is idle, start it; the interrupt does the rest. */
+	if (!ls->ls_wbusy && spscring_read(&ls->ls_txring, &ch, 1) == 1) {
+		ls->ls_wbusy = true;
+		bus_write_register(ls->ls_busdata, ls->ls_buspos,
+				   LSER_REG_CHAR, (unsigned char)ch);
+	}
+
+	spinlock_release(&ls->ls_lock);
+	return n;
+}
+
 static
 void
 lser_poll_until_write(struct lser_softc *sc)
@@ -170,7 +219,23 @@ void
 lser_startpolling(void *vsc)
 {
 	struct lser_softc *sc = vsc;
+	bool more;
+	char ch;
+
 	sc->ls_maskinterrupt(sc->ls_busdata, sc->ls_buspos);
+
+	/*
+	 * Push out whatever is still in the transmit buffer first, so
+	 * output isn't reordered and, if we're panicking, isn't lost.
+	 */
+	do {
+		spinlock_acquire(&sc->ls_lock);
+		more = spscring_read(&sc->ls_txring, &ch, 1) == 1;
+		spinlock_release(&sc->ls_lock);
+		if (more) {
+			lser_writepolled(sc, ch);
+		}
+	} while (more);
 }
 
 void
@@ -191,6 +256,9 @@ config_lser(struct lser_softc *sc, int lserno)
 
 	spinlock_init(&sc->ls_lock);
 	sc->ls_wbusy = false;
+	spscring_init(&sc->ls_txring, sc->ls_txbuf, LSER_TXBUFSIZE);
+	sc->ls_txwaiting = false;
+	sc->ls_txsingle = false;
 
 	bus_write_register(sc->ls_busdata, sc->ls_buspos,
 			   LSER_REG_RIRQ, LSER_IRQ_ENABLE);
@@ -31,12 +31,26 @@
 #define _LAMEBUS_LSER_H_
 
 #include <spinlock.h>
+#include <spscring.h>
+
+/* Size of the transmit buffer; must be a power of 2 */
+#define LSER_TXBUFSIZE  1024
 
 struct lser_softc {
 	/* Initialized by config function */
 	struct spinlock ls_lock;    /* protects ls_wbusy and device regs */
 	volatile bool ls_wbusy;     /* true if write in progress */
 
+	/*
+	 * Transmit buffer for lser_writebuf, drained a character at a
+	 * time from the write-done interrupt. Protected by ls_lock.
+	 * While it's nonempty, ls_wbusy is true.
+	 */
+	struct spscring ls_txring;
+	char ls_txbuf[LSER_TXBUFSIZE];
+	bool ls_txwaiting;          /* a writer is waiting for space */
+	bool ls_txsingle;           /* write in progress is lser_write's */
+
 	/* Initialized by lower-level attachment function */
 	void *ls_busdata;
 	uint32_t ls_buspos;
@@ -52,8 +66,18 @@ struct lser_softc {
 /* Functions called by lower-level drivers */
 void lser_irq(/*struct lser_softc*/ void *sc);
 
-/* Functions called by higher-level drivers */
+/*
+ * Functions called by higher-level drivers
+ *
+ * lser_write sends one character; the caller must wait for ls_start
+ * before sending another. lser_writebuf instead queues up to LEN
+ * characters in the transmit buffer and returns how many fit; if not
+ * all of them did, ls_start is called once there's room again. Don't
+ * mix the two.
+ */
 void lser_write(/*struct lser_softc*/ void *sc, int ch);
+size_t lser_writebuf(/*struct lser_softc*/ void *sc, const char *buf,
+		     size_t len);
 void lser_startpolling(/*struct lser_softc*/ void *sc);
 void lser_writepolled(/*struct lser_softc*/ void *sc, int ch);
 void lser_endpolling(/*struct lser_softc*/ void *sc);
@@ -38,6 +38,7 @@
 #include <stat.h>
 #include <lib.h>
 #include <array.h>
+#include <atomic.h>
 #include <bitmap.h>
 #include <uio.h>
 #include <synch.h>
@@ -900,11 +901,15 @@ sfs_reclaim(struct vnode *v)
 	 * decision was made to reclaim it. (You must also synchronize
 	 * this with sfs_loadvnode.)
 	 */
-	if (v->vn_refcount != 1) {
+	if (atomic_load(&v->vn_refcount) != 1) {
 
-		/* consume the reference VOP_DECREF gave us */
-		KASSERT(v->vn_refcount>1);
-		v->vn_refcount--;
+		/*
+		 * Consume the reference VOP_DECREF gave us. It must be
+		 * atomic as VOP_INCREF and VOP_DECREF don't take the
+		 * biglock.
+		 */
+		KASSERT(atomic_load(&v->vn_refcount)>1);
+		atomic_dec(&v->vn_refcount);
 
 		vfs_biglock_release();
 		return EBUSY;
@@ -0,0 +1,80 @@
+/*
+ * Copyright (c) 2000, 2001
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#ifndef _ATOMIC_H_
+#define _ATOMIC_H_
+
+/*
+ * Atomic operations on 32-bit words, for lock-free code.
+ *
+ * The guts are machine-dependent. Every machine provides, for both
+ * unsigned words and pointers:
+ *
+ *     atomic_load(p)           - read *p.
+ *     atomic_store(p, v)       - write *p.
+ *     atomic_cas(p, old, new)  - if *p is OLD, set it to NEW. Returns
+ *                                what *p was either way, so the swap
+ *                                happened iff the result equals OLD.
+ *     atomic_swap(p, new)      - set *p to NEW; return the old value.
+ *
+ * and for unsigned words only:
+ *
+ *     atomic_fetchadd(p, d)    - add D to *p; return the old value.
+ *                                Subtract by adding (unsigned)-N.
+ *     atomic_inc(p)            - add 1 to *p; return the new value.
+ *     atomic_dec(p)            - subtract 1 from *p; return the new
+ *                                value, so a refcount holder can tell
+ *                                if it dropped the last reference.
+ *
+ * The pointer versions are atomic_loadptr, atomic_storeptr,
+ * atomic_casptr and atomic_swapptr.
+ *
+ * None of these order other memory accesses. For that there are
+ * barriers, which also stop the compiler moving accesses across them:
+ *
+ *     membar_producer()  - stores before it are seen before stores
+ *                          after it (publish data, then the index).
+ *     membar_consumer()  - loads before it happen before loads after
+ *                          it (read the index, then the data).
+ *     membar_any_any()   - all accesses before it happen before all
+ *                          accesses after it.
+ */
+
+#include <cdefs.h>
+
+/* Inlining support - for making sure an out-of-line copy gets built */
+#ifndef ATOMIC_INLINE
+#define ATOMIC_INLINE INLINE
+#endif
+
+/* Get the machine-dependent bits. */
+#include <machine/atomic.h>
+
+
+#endif /* _ATOMIC_H_ */
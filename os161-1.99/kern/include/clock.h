@@ -44,6 +44,10 @@
  * gettime() may be used to fetch the current time of day.
  * getinterval() computes the time from time1 to time2.
  *
+ * gettime_usec() returns the time of day in microseconds, for cheap
+ * interval timing. Unlike gettime() it may be called before the
+ * clock device attaches, in which case it returns 0.
+ *
  * XXX we have struct timespec now, let's use it.
  */
 
@@ -62,6 +66,7 @@ void hardclock(void);
 void timerclock(void);
 
 void gettime(time_t *seconds, uint32_t *nanoseconds);
+uint64_t gettime_usec(void);
 
 void getinterval(time_t secs1, uint32_t nsecs,
                  time_t secs2, uint32_t nsecs2,
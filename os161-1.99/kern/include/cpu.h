@@ -33,6 +33,8 @@
 
 #include <spinlock.h>
 #include <threadlist.h>
+#include <epoch.h>
+#include <workqueue.h>
 #include <machine/vm.h>  /* for TLBSHOOTDOWN_MAX */
 
 
@@ -59,7 +61,21 @@ struct cpu {
 	 */
 	struct thread *c_curthread;	/* Current thread on cpu */
 	struct threadlist c_zombies;	/* List of exited threads */
+	struct threadlist c_threadcache; /* Reaped threads for reuse */
+	struct threadlist c_reaplist;	/* Reaped threads to destroy */
+	struct work c_reapwork;		/* Destroys c_reaplist */
 	unsigned c_hardclocks;		/* Counter of hardclock() calls */
+	uint64_t c_starttime;		/* When the cpu was created, usec */
+	uint64_t c_idletime;		/* Time spent in cpu_idle, usec */
+	unsigned c_interrupts;		/* Counter of interrupts taken */
+	unsigned c_epoch_depth;		/* Epoch read section nesting */
+	struct epoch_entry *c_epoch_head; /* Pending epoch cleanups */
+	struct epoch_entry *c_epoch_tail;
+
+	/*
+	 * Accessed by other cpus, unlocked.
+	 */
+	volatile unsigned c_epoch;	/* Epoch at last thread_switch */
 
 	/*
 	 * Accessed by other cpus.
@@ -67,6 +83,8 @@ struct cpu {
 	 */
 	bool c_isidle;			/* True if this cpu is idle */
 	struct threadlist c_runqueue;	/* Run queue for this cpu */
+	struct threadlist c_rtqueue;	/* Real-time run queue, by priority */
+	unsigned c_rtutil;		/* Admitted real-time load, per mille */
 	struct spinlock c_runqueue_lock;
 
 	/*
@@ -86,7 +104,15 @@ struct cpu {
 	uint32_t c_ipi_pending;		/* One bit for each IPI number */
 	struct tlbshootdown c_shootdown[TLBSHOOTDOWN_MAX];
 	int c_numshootdown;
+	unsigned c_ipi_received;	/* Hardware IPIs taken */
 	struct spinlock c_ipi_lock;
+
+	/*
+	 * IPI statistics for IPIs this cpu sent; see ipi_send. Only
+	 * changed by this cpu, with interrupts off.
+	 */
+	unsigned c_ipi_sent;		/* Hardware IPIs raised */
+	unsigned c_ipi_coalesced;	/* Requests folded into one pending */
 };
 
 #define TLBSHOOTDOWN_ALL  (-1)
@@ -109,6 +135,14 @@ void cpu_machdep_init(struct cpu *);
 /*ASMLINKAGE*/ void cpu_start_secondary(void);
 void cpu_hatch(unsigned software_number);
 
+/*
+ * Number of cpus. Cpu numbers run from 0 to cpu_count()-1. Only
+ * final once thread_start_cpus() has run. cpu_get returns cpu
+ * number NUM.
+ */
+unsigned cpu_count(void);
+struct cpu *cpu_get(unsigned num);
+
 /*
  * Return a string describing the CPU type.
  */
@@ -152,9 +186,17 @@ void cpu_halt(void);
  * ipi_send sends an IPI to one CPU.
  * ipi_broadcast sends an IPI to all CPUs except the current one.
  * ipi_tlbshootdown is like ipi_send but carries TLB shootdown data.
+ * ipi_tlbshootdown_broadcast is ipi_tlbshootdown to all CPUs except
+ * the current one.
+ *
+ * IPIs coalesce: if the target already has an IPI pending that it
+ * hasn't taken yet, the new request is added to the pending set
+ * without interrupting it again.
  *
  * interprocessor_interrupt is called on the target CPU when an IPI is
- * received.
+ * received, after the hardware IPI has been acknowledged. It returns
+ * true for IPI_PREEMPT; the caller should then thread_yield once it
+ * is done with the interrupt, as for a timer tick.
  */
 
 /* IPI types */
@@ -162,12 +204,14 @@ void cpu_halt(void);
 #define IPI_OFFLINE		1	/* CPU is requested to go offline */
 #define IPI_UNIDLE		2	/* Runnable threads are available */
 #define IPI_TLBSHOOTDOWN	3	/* MMU mapping(s) need invalidation */
+#define IPI_PREEMPT		4	/* Another thread should run now */
 
 void ipi_send(struct cpu *target, int code);
 void ipi_broadcast(int code);
 void ipi_tlbshootdown(struct cpu *target, const struct tlbshootdown *mapping);
+void ipi_tlbshootdown_broadcast(const struct tlbshootdown *mapping);
 
-void interprocessor_interrupt(void);
+bool interprocessor_interrupt(void);
 
 
 #endif /* _CPU_H_ */
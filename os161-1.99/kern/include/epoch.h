@@ -0,0 +1,79 @@
+/*
+ * Copyright (c) 2000, 2001, 2002, 2003, 2004, 2005, 2008, 2009
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#ifndef _EPOCH_H_
+#define _EPOCH_H_
+
+/*
+ * Epoch-based reclamation, for data that is read far more often
+ * than it changes.
+ *
+ * Readers bracket their accesses with epoch_enter() and epoch_exit().
+ * This only raises the interrupt level on the current cpu; it takes
+ * no lock and writes nothing shared, so any number of cpus can read
+ * at once. Inside the section, readers may not sleep or do anything
+ * else that could lead to a context switch.
+ *
+ * Writers still need a lock among themselves. To change something,
+ * a writer publishes a new version (e.g. replaces a pointer with one
+ * to an updated copy) and hands the old version to epoch_call(),
+ * which runs the given cleanup function once every reader that might
+ * still see the old version has left its read section.
+ *
+ * Since a read section can't contain a context switch, a cpu that has
+ * been through thread_switch (or is idle) since the old version was
+ * unpublished can't still be looking at it. Each cpu records the
+ * global epoch number every time it goes through thread_switch, and
+ * cleanup functions queued under epoch N run once every other cpu
+ * has recorded N or later. Pending cleanups are kept per-cpu and run
+ * from thread_switch, with interrupts off, so they must not sleep;
+ * kfree is fine.
+ *
+ * epoch_synchronize() waits for such a grace period directly.
+ */
+
+struct epoch_entry {
+	struct epoch_entry *ee_next;
+	unsigned ee_epoch;		/* safe once all cpus are here */
+	void (*ee_func)(void *);
+	void *ee_arg;
+};
+
+void epoch_enter(void);
+void epoch_exit(void);
+
+void epoch_call(void (*func)(void *), void *arg);
+void epoch_synchronize(void);
+
+/* Called from thread_switch. */
+void epoch_quiescent(void);
+void epoch_reclaim(void);
+
+
+#endif /* _EPOCH_H_ */
@@ -0,0 +1,99 @@
+/*
+ * Copyright (c) 2000, 2001
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#ifndef _FILE_H_
+#define _FILE_H_
+
+/*
+ * Open files and file descriptor tables.
+ *
+ * A file descriptor is an index into its process's p_fds, which
+ * points to an openfile: the vnode plus what open() set up, namely
+ * the access mode and the seek position. dup2 and fork make more
+ * descriptors for the same openfile, and they share the position,
+ * as in Unix. The openfile goes away, closing the vnode, when the
+ * last reference does.
+ *
+ * p_fds is protected by the process's p_lock. of_offset is
+ * protected by of_lock, which is held across each read, write or
+ * seek so that two of them can't use the same offset. of_refcount
+ * counts descriptors plus calls in progress and is changed with
+ * the operations in <atomic.h>.
+ */
+
+#include "opt-A2.h"
+
+#if OPT_A2
+
+struct vnode;
+struct lock;
+struct proc;
+
+struct openfile {
+	struct vnode *of_vnode;
+	int of_accmode;			/* O_RDONLY, O_WRONLY or O_RDWR */
+	bool of_append;			/* O_APPEND: writes go at EOF */
+	off_t of_offset;		/* Seek position */
+	struct lock *of_lock;		/* Lock for of_offset and I/O */
+	volatile unsigned of_refcount;	/* References */
+};
+
+/*
+ * openfile_open opens PATH (a kernel string, which vfs_open may
+ * change) with open() FLAGS and MODE and returns an openfile with
+ * one reference. openfile_incref and openfile_decref add and drop
+ * references.
+ */
+int openfile_open(char *path, int flags, mode_t mode, struct openfile **ret);
+void openfile_incref(struct openfile *of);
+void openfile_decref(struct openfile *of);
+
+/*
+ * Descriptor table operations:
+ *    fd_get           - look up descriptor FD in P's table and return
+ *                       its openfile with a reference added. EBADF if
+ *                       FD isn't open.
+ *    fd_add           - put OF in the lowest free slot of P's table,
+ *                       taking over the caller's reference. EMFILE
+ *                       if the table is full.
+ *    fdtable_console  - open the console as descriptors 0, 1 and 2
+ *                       of P, whose table must be empty.
+ *    fdtable_copy     - give DST, whose table must be empty, the
+ *                       same descriptors as SRC (for fork).
+ *    fdtable_closeall - close all of P's descriptors.
+ */
+int fd_get(struct proc *p, int fd, struct openfile **ret);
+int fd_add(struct proc *p, struct openfile *of, int *fd);
+int fdtable_console(struct proc *p);
+void fdtable_copy(struct proc *src, struct proc *dst);
+void fdtable_closeall(struct proc *p);
+
+#endif /* OPT_A2 */
+
+#endif /* _FILE_H_ */
@@ -0,0 +1,70 @@
+/*
+ * Copyright (c) 2000, 2001
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#ifndef _FUTEX_H_
+#define _FUTEX_H_
+
+/*
+ * Futexes: blocking for user-level synchronization.
+ *
+ * A futex is just a 32-bit word in user memory. User code does all
+ * the real work on it with atomic instructions (ll/sc) and only
+ * enters the kernel to block when it has to wait, or to wake waiters
+ * when it knows there are some. An uncontended lock or unlock
+ * therefore makes no system call at all.
+ *
+ *    futex_wait(addr, val) - if *addr still holds val, sleep until a
+ *                            futex_wake on addr. Fails with EAGAIN if
+ *                            *addr has changed, so a wakeup between
+ *                            the caller's last look and the sleep
+ *                            can't be lost.
+ *    futex_wake(addr, n)   - wake up to n threads sleeping in
+ *                            futex_wait on addr; returns how many
+ *                            were woken.
+ *
+ * Waiters are keyed by the physical address of the word (page plus
+ * offset), not the virtual one, so the same word reached through
+ * different mappings is the same futex. The kernel keeps a hash table
+ * of the addresses that have sleepers, each with its own wchan; a
+ * futex costs no kernel memory while nobody is waiting on it.
+ *
+ * addr must be 4-byte aligned. As with any futex, callers must
+ * expect futex_wait to return without a matching futex_wake, and
+ * recheck the word.
+ */
+
+struct proc;
+
+void futex_bootstrap(void);
+
+/* Wake all of a process's futex waiters (used when it exits). */
+void futex_wakeproc(struct proc *p);
+
+
+#endif /* _FUTEX_H_ */
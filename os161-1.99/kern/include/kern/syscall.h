@@ -197,6 +197,15 @@
 #define SYS_reboot       119
 //#define SYS___sysctl   120
 
+//                              -- Synchronization --
+#define SYS_futex_wait   121
+#define SYS_futex_wake   122
+
+//                              -- Threads --
+#define SYS_thread_create 123
+#define SYS_thread_exit  124
+#define SYS_thread_join  125
+
 /*CALLEND*/
 
 
@@ -157,11 +157,21 @@ const char *strerror(int errcode);
  * putch_prepare and putch_complete should be called around a series
  * of putch() calls, if printing in polling mode is a possibility.
  * kprintf does this.
+ *
+ * putbuf is like calling putch on each character of BUF, but hands
+ * them to the device in one go when it has a transmit buffer and
+ * we're allowed to sleep.
+ *
+ * getch_interrupt wakes a thread sleeping in a user-level read of
+ * the console, so it can see that its process is exiting. getch
+ * itself ignores it and keeps waiting.
  */
 void putch(int ch);
+void putbuf(const char *buf, size_t len);
 void putch_prepare(void);
 void putch_complete(void);
 int getch(void);
+void getch_interrupt(void);
 void beep(void);
 
 /*
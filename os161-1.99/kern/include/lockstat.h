@@ -0,0 +1,112 @@
+/*
+ * Copyright (c) 2000, 2001, 2002, 2003, 2004, 2005, 2008, 2009
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#ifndef _LOCKSTAT_H_
+#define _LOCKSTAT_H_
+
+/*
+ * Lock contention statistics ("options lockstat").
+ *
+ * Each spinlock, lock, semaphore, and cv carries a struct lockstat.
+ * The owning primitive updates it while holding its own internal
+ * lock, so the counters themselves need no extra locking. Stats are
+ * entered in a global table, by name, the first time they're
+ * touched, and taken out again when the primitive is destroyed.
+ *
+ * What gets counted:
+ *    acquires   - successful acquisitions (P for semaphores, waits
+ *                 for cvs)
+ *    contended  - acquisitions that had to spin or sleep first
+ *    wait time  - total and maximum time spent spinning or asleep
+ *    hold time  - maximum time held (spinlocks and locks only)
+ *
+ * Times are in microseconds, from gettime_usec().
+ *
+ * Reading the clock is far more expensive than taking an
+ * uncontended lock, so wait time is only measured for contended
+ * acquisitions, and hold time only for every LOCKSTAT_HOLDSAMPLE'th
+ * acquisition plus all contended ones. Spinlocks are only counted
+ * once they have a name (spinlock_setname or
+ * SPINLOCK_NAMED_INITIALIZER); the anonymous ones inside wchans,
+ * semaphores, and locks would just be noise.
+ */
+
+typedef enum {
+	LOCKSTAT_SPINLOCK,
+	LOCKSTAT_LOCK,
+	LOCKSTAT_SEM,
+	LOCKSTAT_CV,
+} lockstat_kind_t;
+
+struct lockstat {
+	const char *ls_name;		/* NULL means don't count */
+	lockstat_kind_t ls_kind;
+	bool ls_registered;		/* in the global table */
+	unsigned ls_acquires;
+	unsigned ls_contended;
+	uint64_t ls_waitusec;		/* total wait */
+	uint32_t ls_maxwaitusec;
+	uint32_t ls_maxholdusec;
+	uint64_t ls_holdstart;		/* 0 if this hold isn't timed */
+	struct lockstat *ls_prev;	/* global table linkage */
+	struct lockstat *ls_next;
+};
+
+#define LOCKSTAT_INITIALIZER(name, kind) \
+	{ name, kind, false, 0, 0, 0, 0, 0, 0, NULL, NULL }
+
+/* Time every 16th hold. Must be a power of 2. */
+#define LOCKSTAT_HOLDSAMPLE	16
+
+/*
+ * Functions:
+ *    lockstat_init       - set up an entry; NAME must outlive it.
+ *    lockstat_cleanup    - take the entry out of the table.
+ *    lockstat_now        - timestamp for starting a wait.
+ *    lockstat_acquired   - count an acquisition. If CONTENDED,
+ *                          WAITSTART is the lockstat_now() from
+ *                          when the wait began.
+ *    lockstat_released   - end a hold, for hold times.
+ *    lockstat_dump       - print the MAX most contended entries and
+ *                          reset all the counters.
+ *
+ * lockstat_acquired and lockstat_released must be called with the
+ * primitive's own internal lock held.
+ */
+void lockstat_init(struct lockstat *ls, const char *name,
+		   lockstat_kind_t kind);
+void lockstat_cleanup(struct lockstat *ls);
+uint64_t lockstat_now(void);
+void lockstat_acquired(struct lockstat *ls, bool contended,
+		       uint64_t waitstart);
+void lockstat_released(struct lockstat *ls);
+void lockstat_dump(unsigned max);
+
+
+#endif /* _LOCKSTAT_H_ */
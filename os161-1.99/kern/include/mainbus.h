@@ -55,6 +55,16 @@ size_t mainbus_ramsize(void);
 /* Switch on an inter-processor interrupt. (Low-level.) */
 void mainbus_send_ipi(struct cpu *target);
 
+/*
+ * Stop and restart hardclock() on the current cpu, so an idle cpu
+ * isn't woken HZ times a second for nothing. A stopped timer still
+ * fires every so often (a handful of times a second on sys161), so
+ * an idle cpu rechecks its run queues even if an IPI goes missing.
+ * (Low-level.)
+ */
+void mainbus_hardclock_stop(void);
+void mainbus_hardclock_start(void);
+
 /*
  * The various ways to shut down the system. (These are very low-level
  * and should generally not be called directly - md_poweroff, for
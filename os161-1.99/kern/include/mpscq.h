@@ -0,0 +1,85 @@
+/*
+ * Copyright (c) 2000, 2001
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#ifndef _MPSCQ_H_
+#define _MPSCQ_H_
+
+/*
+ * Bounded lock-free multi-producer/single-consumer queue of pointers.
+ *
+ * Unlike struct queue, this never allocates and takes no locks, so
+ * it can be used from interrupt handlers and while holding
+ * spinlocks. Any number of threads or interrupt handlers on any cpus
+ * may call mpscq_put at once; only one at a time may call mpscq_get,
+ * which the caller arranges (usually there is only one consumer
+ * thread). Items come out in the order their puts claimed slots,
+ * which for any one producer is the order it put them.
+ *
+ * The caller supplies the slot array, whose size must be a power of
+ * two, e.g.
+ *
+ *     static struct mpscq_slot myslots[64];
+ *     mpscq_init(&myq, myslots, 64);
+ *
+ * Each slot carries a sequence number saying whose turn it is: the
+ * producer that will fill it, or the consumer that will empty it.
+ * Producers claim slots by advancing mq_tail with compare-and-swap
+ * and publish them by bumping the sequence number. The consumer
+ * never writes mq_tail and producers never write mq_head.
+ *
+ * Functions:
+ *     mpscq_init   - initialize with SLOTS, an array of SIZE slots.
+ *     mpscq_put    - add PTR (which must not be NULL). Returns false,
+ *                    without blocking, if the queue is full.
+ *     mpscq_get    - remove and return the oldest item, or NULL if
+ *                    there isn't one. An item whose producer hasn't
+ *                    finished publishing it doesn't count yet.
+ *     mpscq_empty  - true if mpscq_get would return NULL right now.
+ *                    Only meaningful to the consumer.
+ */
+
+struct mpscq_slot {
+	volatile unsigned ms_seq;
+	void *volatile ms_ptr;
+};
+
+struct mpscq {
+	struct mpscq_slot *mq_slots;
+	unsigned mq_mask;		/* number of slots - 1 */
+	volatile unsigned mq_tail;	/* next slot to claim; producers */
+	unsigned mq_head;		/* next slot to empty; consumer */
+};
+
+void mpscq_init(struct mpscq *mq, struct mpscq_slot *slots, unsigned size);
+bool mpscq_put(struct mpscq *mq, void *ptr);
+void *mpscq_get(struct mpscq *mq);
+bool mpscq_empty(struct mpscq *mq);
+
+
+#endif /* _MPSCQ_H_ */
@@ -0,0 +1,94 @@
+/*
+ * Copyright (c) 2000, 2001, 2002, 2003, 2004, 2005, 2008, 2009
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#ifndef _PCPU_COUNTER_H_
+#define _PCPU_COUNTER_H_
+
+/*
+ * Per-cpu counters, for statistics that are bumped on hot paths and
+ * read rarely.
+ *
+ * Each cpu accumulates a private delta in its own slot, padded out
+ * to a cache line so that cpus incrementing the same counter don't
+ * fight over it. When a cpu's delta reaches the counter's batch size
+ * it is folded into the shared total under pc_lock. An update is
+ * therefore a few instructions at splhigh, plus a spinlock once
+ * every "batch" updates.
+ *
+ * Functions:
+ *     pcpu_counter_init    - initialize; batch 0 means the default.
+ *     pcpu_counter_cleanup - clean up.
+ *     pcpu_counter_inc     - add one.
+ *     pcpu_counter_add     - add a (possibly negative) delta.
+ *     pcpu_counter_read    - approximate value: the shared total
+ *                            only, without the per-cpu deltas. Off
+ *                            by less than batch per cpu, but never
+ *                            touches the other cpus' slots.
+ *     pcpu_counter_sum     - exact value: the shared total plus all
+ *                            per-cpu deltas, under pc_lock.
+ *     pcpu_counter_reset   - set to zero. Updates racing with the
+ *                            reset may or may not be kept.
+ *
+ * Counters may be updated from interrupt handlers. Since cpu numbers
+ * are handed out densely from 0, slots are a fixed array indexed by
+ * cpu number, which also lets counters be statically initialized.
+ */
+
+#include <spinlock.h>
+
+#define PCPU_COUNTER_MAXCPUS	32
+#define PCPU_COUNTER_BATCH	32	/* default batch size */
+#define PCPU_COUNTER_LINESIZE	32	/* slot size, in bytes */
+
+struct pcpu_counter_slot {
+	volatile int32_t pcs_delta;
+	char pcs_pad[PCPU_COUNTER_LINESIZE - sizeof(int32_t)];
+};
+
+struct pcpu_counter {
+	struct spinlock pc_lock;	/* protects pc_total */
+	int64_t pc_total;		/* folded-in deltas */
+	unsigned pc_batch;
+	struct pcpu_counter_slot pc_slots[PCPU_COUNTER_MAXCPUS];
+};
+
+/* Static initializer; the slots are zeroed by the compiler. */
+#define PCPU_COUNTER_INITIALIZER \
+	{ SPINLOCK_INITIALIZER, 0, PCPU_COUNTER_BATCH, { { 0, { 0 } } } }
+
+void pcpu_counter_init(struct pcpu_counter *pc, unsigned batch);
+void pcpu_counter_cleanup(struct pcpu_counter *pc);
+void pcpu_counter_inc(struct pcpu_counter *pc);
+void pcpu_counter_add(struct pcpu_counter *pc, int32_t delta);
+int64_t pcpu_counter_read(struct pcpu_counter *pc);
+int64_t pcpu_counter_sum(struct pcpu_counter *pc);
+void pcpu_counter_reset(struct pcpu_counter *pc);
+
+
+#endif /* _PCPU_COUNTER_H_ */
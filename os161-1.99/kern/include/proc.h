@@ -43,14 +43,34 @@
 #if OPT_A2
 	// ASST2a
 	#include <synch.h>
+	#include <limits.h>
 #endif
 
 struct addrspace;
 struct vnode;
+#if OPT_A2
+struct openfile;
+#endif
 #ifdef UW
 struct semaphore;
 #endif // UW
 
+#if OPT_A2
+	/*
+	 * Record of a user thread made by thread_create, kept in its
+	 * process until thread_join collects it (or the process goes
+	 * away). Protected by the process's p_lck. The thread itself
+	 * finds it through t_uthread.
+	 */
+	struct uthread {
+		int ut_tid;             // thread id within the process
+		bool ut_exited;         // has called thread_exit
+		bool ut_joining;        // someone is in thread_join on it
+		int ut_retval;          // value given to thread_exit
+		struct uthread *ut_next;
+	};
+#endif
+
 /*
  * Process structure.
  */
@@ -66,31 +86,75 @@ struct proc {
 	struct vnode *p_cwd;		/* current working directory */
 
 #ifdef UW
+	#if OPT_A2
+		/* file descriptor table, under p_lock; see <file.h> */
+		struct openfile *p_fds[OPEN_MAX];
+	#else
   /* a vnode to refer to the console device */
   /* this is a quick-and-dirty way to get console writes working */
   /* you will probably need to change this when implementing file-related
      system calls, since each process will need to keep track of all files
      it has opened, not just the console. */
   struct vnode *console;                /* a vnode for the console device */
+	#endif
 #endif
 
 	#if OPT_A2
 		// ASST2a
 		/* add more material here as needed */
 		pid_t p_pid; // Process identifer
-		struct array *p_children; // Ptr to array of children processes
+
+		/*
+		 * Family. Everything here but p_childcv is protected by
+		 * proc_familylock. A process's children are on one of
+		 * two lists, linked through their p_sibprev/p_sibnext:
+		 * p_livechildren while they run, and p_deadchildren
+		 * once they've exited and until waitpid collects them.
+		 * waitpid sleeps on p_childcv; each exiting child
+		 * signals its parent's once.
+		 */
 		struct proc *p_parent; // Ptr to parent process
+		struct proc *p_livechildren; // children still running
+		struct proc *p_deadchildren; // exited, not yet waited for
+		struct proc *p_sibprev; // links in the parent's lists
+		struct proc *p_sibnext;
 		int p_exitcode; // exitcode
 		int p_exitstatus; // running = 0 or exited = 1
-
-		struct lock *p_lck; // Process cv lock
-		struct cv *p_cv; // Process condition variable
+		struct cv *p_childcv; // a child has exited
+
+		struct lock *p_lck; // Process thread lock
+
+		/*
+		 * User threads. The list, p_nexttid, and thread_join
+		 * sleeping on p_threadcv are all under p_lck. p_exiting
+		 * and p_exitpending are set under p_lock by the first
+		 * thread to call _exit; every thread checks p_exiting
+		 * on its way back to user mode and leaves the process,
+		 * and the last one out tears it down.
+		 *
+		 * _exit wakes siblings sleeping in thread_join, waitpid,
+		 * futex_wait and console reads. Any other sleep (a lock or
+		 * cv wait, a disk or emufs read) is not interrupted: the
+		 * thread only leaves once that sleep ends by itself, and
+		 * until then the process is not torn down and its parent's
+		 * waitpid does not return.
+		 */
+		struct uthread *p_uthreads; // threads from thread_create
+		int p_nexttid; // next thread id (the first thread is 0)
+		struct cv *p_threadcv; // thread_join waits here
+		volatile bool p_exiting; // _exit has been called
+		int p_exitpending; // code passed to _exit
 	#endif
 };
 
 /* This is the process structure for the kernel and for kernel-only threads. */
 extern struct proc *kproc;
 
+#if OPT_A2
+/* Lock for the family fields of every process; see struct proc. */
+extern struct lock *proc_familylock;
+#endif
+
 /* Semaphore used to signal when there are no more processes */
 #ifdef UW
 extern struct semaphore *no_proc_sem;
@@ -99,17 +163,32 @@ extern struct semaphore *no_proc_sem;
 /* Call once during system startup to allocate data structures. */
 void proc_bootstrap(void);
 
-/* Create a fresh process for use by runprogram(). */
+/*
+ * Create a fresh process for use by runprogram(). Returns NULL if
+ * out of memory or PIDs.
+ */
 struct proc *proc_create_runprogram(const char *name);
 
+#if OPT_A2
+/*
+ * Find the process with PID PID, or NULL. The proc isn't referenced
+ * or locked; the caller must know it can't be destroyed in the
+ * meantime (e.g. because it's the caller's own child).
+ */
+struct proc *proc_lookup(pid_t pid);
+#endif
+
 /* Destroy a process. */
 void proc_destroy(struct proc *proc);
 
 /* Attach a thread to a process. Must not already have a process. */
 int proc_addthread(struct proc *proc, struct thread *t);
 
-/* Detach a thread from its process. */
-void proc_remthread(struct thread *t);
+/*
+ * Detach a thread from its process. Returns the number of threads
+ * left in the process; the thread that sees 0 was the last one.
+ */
+unsigned proc_remthread(struct thread *t);
 
 /* Fetch the address space of the current process. */
 struct addrspace *curproc_getas(void);
@@ -37,6 +37,9 @@
 
 #include <cdefs.h>
 
+#include "opt-ticketlock.h"
+#include "opt-lockstat.h"
+
 /* Inlining support - for making sure an out-of-line copy gets built */
 #ifndef SPINLOCK_INLINE
 #define SPINLOCK_INLINE INLINE
@@ -45,6 +48,10 @@
 /* Get the machine-dependent bits. */
 #include <machine/spinlock.h>
 
+#if OPT_LOCKSTAT
+#include <lockstat.h>
+#endif
+
 /*
  * Basic spinlock.
  *
@@ -53,16 +60,48 @@
  * This structure is made public so spinlocks do not have to be
  * malloc'd; however, code that uses spinlocks should not look inside
  * the structure directly but always use the spinlock API functions.
+ *
+ * With "options ticketlock" the lock is a ticket lock: each cpu that
+ * wants the lock takes the next number from lk_next and waits until
+ * lk_serving reaches it. Cpus get the lock in the order they asked
+ * for it, and while waiting they only read lk_serving, which changes
+ * once per release, instead of all hammering the lock word with
+ * test-and-set when it comes free. Otherwise the lock is a single
+ * test-and-set word, which is cheaper when uncontended but unfair.
  */
 struct spinlock {
+#if OPT_TICKETLOCK
+	volatile spinlock_data_t lk_next; /* Next ticket to hand out. */
+	volatile spinlock_data_t lk_serving; /* Ticket allowed in now. */
+#else
 	volatile spinlock_data_t lk_lock; /* The memory word where we spin. */
+#endif
 	struct cpu *lk_holder;		/* CPU holding this lock. */
+#if OPT_LOCKSTAT
+	struct lockstat lk_stat;	/* Contention statistics. */
+#endif
 };
 
 /*
  * Initializer for cases where a spinlock needs to be static or global.
+ * The named version also gives it a name for lock statistics.
  */
-#define SPINLOCK_INITIALIZER	{ SPINLOCK_DATA_INITIALIZER, NULL }
+#if OPT_LOCKSTAT
+#define SPINLOCK_STAT_INITIALIZER(name) \
+	, LOCKSTAT_INITIALIZER(name, LOCKSTAT_SPINLOCK)
+#else
+#define SPINLOCK_STAT_INITIALIZER(name)
+#endif
+
+#if OPT_TICKETLOCK
+#define SPINLOCK_NAMED_INITIALIZER(name)	\
+	{ SPINLOCK_DATA_INITIALIZER, SPINLOCK_DATA_INITIALIZER, NULL \
+	  SPINLOCK_STAT_INITIALIZER(name) }
+#else
+#define SPINLOCK_NAMED_INITIALIZER(name)	\
+	{ SPINLOCK_DATA_INITIALIZER, NULL SPINLOCK_STAT_INITIALIZER(name) }
+#endif
+#define SPINLOCK_INITIALIZER	SPINLOCK_NAMED_INITIALIZER(NULL)
 
 /*
  * Spinlock functions.
@@ -74,10 +113,14 @@ struct spinlock {
  * release	Release the lock. May re-enable interrupts.
  *
  * do_i_hold	Check if the current CPU holds the lock.
+ *
+ * setname	Name the lock, so it shows up in lock statistics. The
+ *		string is not copied. Does nothing without lockstat.
  */
 
 void spinlock_init(struct spinlock *lk);
 void spinlock_cleanup(struct spinlock *lk);
+void spinlock_setname(struct spinlock *lk, const char *name);
 
 void spinlock_acquire(struct spinlock *lk);
 void spinlock_release(struct spinlock *lk);
@@ -0,0 +1,72 @@
+/*
+ * Copyright (c) 2000, 2001
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#ifndef _SPSCRING_H_
+#define _SPSCRING_H_
+
+/*
+ * Lock-free single-producer/single-consumer byte ring.
+ *
+ * For passing a byte stream from one side to the other, e.g. from an
+ * interrupt handler to a thread, without a lock between them. One
+ * producer and one consumer may run at once, on any cpus; more than
+ * one of either needs locking among themselves.
+ *
+ * The caller supplies the buffer, whose size must be a power of two.
+ * sr_head and sr_tail run freely and are masked on use, so the ring
+ * can be completely full; the producer only writes sr_tail and the
+ * consumer only writes sr_head.
+ *
+ * Functions:
+ *     spscring_init  - initialize with BUF, SIZE bytes long.
+ *     spscring_write - copy in up to LEN bytes; returns how many fit.
+ *     spscring_read  - copy out up to LEN bytes; returns how many
+ *                      there were.
+ *     spscring_used  - bytes waiting to be read.
+ *     spscring_space - bytes that can be written.
+ *
+ * used and space are exact for the side that calls them (the
+ * consumer and producer respectively) and a lower bound otherwise.
+ */
+
+struct spscring {
+	char *sr_buf;
+	unsigned sr_mask;		/* size - 1 */
+	volatile unsigned sr_head;	/* next byte to read; consumer */
+	volatile unsigned sr_tail;	/* next byte to write; producer */
+};
+
+void spscring_init(struct spscring *sr, char *buf, unsigned size);
+size_t spscring_write(struct spscring *sr, const void *data, size_t len);
+size_t spscring_read(struct spscring *sr, void *data, size_t len);
+unsigned spscring_used(struct spscring *sr);
+unsigned spscring_space(struct spscring *sr);
+
+
+#endif /* _SPSCRING_H_ */
@@ -38,6 +38,7 @@
 #include <spinlock.h>
 
 #include "opt-A1.h"
+#include "opt-lockstat.h"
 
 /*
  * Dijkstra-style semaphore.
@@ -50,6 +51,9 @@ struct semaphore {
 	struct wchan *sem_wchan;
 	struct spinlock sem_lock;
         volatile int sem_count;
+#if OPT_LOCKSTAT
+	struct lockstat sem_stat;       /* protected by sem_lock */
+#endif
 };
 
 struct semaphore *sem_create(const char *name, int initial_count);
@@ -81,8 +85,20 @@ struct lock {
                 // (don't forget to mark things volatile as needed)
                 struct wchan *lck_wchan;
                 struct spinlock lck_lock;
-                struct thread *lck_ownr;
+                struct thread *volatile lck_ownr;
                 volatile bool lck_held;
+
+                bool lck_handoff;       // pass ownership straight to a waiter
+
+                /* contention counters, protected by lck_lock */
+                unsigned lck_nspins;    // waits that spun on a running holder
+                unsigned lck_nsleeps;   // waits that went to sleep
+                unsigned lck_nmissed;   // wakeups that found the lock taken
+                unsigned lck_nboosts;   // holders moved up a run queue
+                unsigned lck_nwaiting;  // threads asleep on lck_wchan
+                #if OPT_LOCKSTAT
+                        struct lockstat lck_stat;       // under lck_lock
+                #endif
         #else
                 char *lk_name;
         #endif
@@ -106,6 +122,49 @@ void lock_acquire(struct lock *);
 void lock_release(struct lock *);
 bool lock_do_i_hold(struct lock *);
 
+#if OPT_A1
+/*
+ * Locks are adaptive: a thread that finds the lock held by a thread
+ * that is currently running on another cpu polls the lock for up to
+ * lock_spinlimit iterations before going to sleep, since the holder
+ * will usually let go well before two context switches could finish.
+ * If the holder is not running, the waiter sleeps immediately.
+ *
+ * Setting lock_spinlimit to 0 gives plain blocking locks.
+ */
+#define LOCK_SPINLIMIT_DEFAULT  1000
+extern unsigned lock_spinlimit;
+
+/*
+ * Handoff mode. Normally lock_release marks the lock free and wakes a
+ * waiter, which then has to compete for it with any thread that
+ * arrives in the meantime; if it loses, it goes back to sleep, which
+ * costs another pair of context switches. In handoff mode, if anyone
+ * is waiting, lock_release instead makes the oldest waiter the owner
+ * before waking it. Waiters then get the lock in FIFO order and never
+ * wake up for nothing, at the price of some throughput (the lock stays
+ * unusable until the new owner gets to run).
+ *
+ * lck_nmissed counts wakeups that found the lock already taken; it
+ * stays at 0 in handoff mode.
+ */
+void lock_sethandoff(struct lock *, bool handoff);
+
+/*
+ * Directed yield. A waiter that finds the holder runnable but not
+ * running (preempted, or queued behind unrelated threads) would
+ * otherwise sleep until the holder's turn comes round, with every
+ * other waiter piling up behind it. Once at least lock_boostwaiters
+ * threads are waiting (counting the new one), the waiter instead
+ * moves the holder to the front of its run queue with thread_boost
+ * before going to sleep, so the critical section finishes first.
+ *
+ * Setting lock_boostwaiters to 0 turns this off.
+ */
+#define LOCK_BOOSTWAITERS_DEFAULT  2
+extern unsigned lock_boostwaiters;
+#endif
+
 
 /*
  * Condition variable.
@@ -127,6 +186,10 @@ struct cv {
                 // add what you need here
                 // (don't forget to mark things volatile as needed)
                 struct wchan *cv_wchan;
+                #if OPT_LOCKSTAT
+                        // under the lock passed to cv_wait
+                        struct lockstat cv_stat;
+                #endif
         #endif
 };
 
@@ -151,4 +214,150 @@ void cv_signal(struct cv *cv, struct lock *lock);
 void cv_broadcast(struct cv *cv, struct lock *lock);
 
 
+/*
+ * Reader-writer lock.
+ *
+ * Any number of threads may hold the lock shared (for reading) at
+ * once, or one thread may hold it exclusive (for writing). The mode
+ * chosen at creation decides who goes first when both readers and
+ * writers are waiting:
+ *
+ *    RW_PREFER_READERS - new readers get in as long as no writer
+ *                        holds the lock. Best throughput for
+ *                        read-mostly data; writers can starve.
+ *    RW_PREFER_WRITERS - once a writer is waiting, new readers wait
+ *                        behind it. Readers can be delayed, but
+ *                        writers can't starve.
+ *
+ * The counters are protected by rw_lock and are only for statistics;
+ * the "waits" counters count acquisitions that had to sleep.
+ *
+ * The name field is for easier debugging. A copy of the name is made
+ * internally.
+ */
+typedef enum {
+        RW_PREFER_READERS,
+        RW_PREFER_WRITERS,
+} rwlock_mode_t;
+
+struct rwlock {
+        char *rw_name;
+        struct spinlock rw_lock;
+        struct wchan *rw_rwchan;        /* readers wait here */
+        struct wchan *rw_wwchan;        /* writers wait here */
+        struct wchan *rw_uwchan;        /* an upgrading reader waits here */
+        rwlock_mode_t rw_mode;
+        volatile unsigned rw_readers;   /* # of threads holding it shared */
+        struct thread *rw_writer;       /* thread holding it exclusive */
+        unsigned rw_rwaiting;           /* # of readers asleep */
+        unsigned rw_wwaiting;           /* # of writers asleep */
+        bool rw_upgrading;              /* a reader is waiting to upgrade */
+
+        unsigned rw_nreads;
+        unsigned rw_nwrites;
+        unsigned rw_nreadwaits;
+        unsigned rw_nwritewaits;
+        unsigned rw_nupgrades;
+        unsigned rw_nfailedupgrades;
+};
+
+struct rwlock *rwlock_create(const char *name, rwlock_mode_t mode);
+void rwlock_destroy(struct rwlock *);
+
+/*
+ * Operations:
+ *    rwlock_acquire_read  - Get the lock shared.
+ *    rwlock_release_read  - Give up a shared hold.
+ *    rwlock_acquire_write - Get the lock exclusive.
+ *    rwlock_release_write - Give up an exclusive hold. Only the thread
+ *                           holding the lock may do this.
+ *    rwlock_tryupgrade    - Turn the caller's shared hold into an
+ *                           exclusive one, waiting for the other
+ *                           readers to leave. Only one reader can be
+ *                           upgrading at a time, since two would wait
+ *                           for each other forever; if another upgrade
+ *                           is already pending, this returns false and
+ *                           the caller still holds the lock shared.
+ *                           (It must then release it and acquire it
+ *                           for writing, and recheck whatever it read.)
+ *    rwlock_downgrade     - Turn the caller's exclusive hold into a
+ *                           shared one without letting any writer in
+ *                           between.
+ *    rwlock_do_i_write    - Return true if the current thread holds
+ *                           the lock exclusive.
+ */
+void rwlock_acquire_read(struct rwlock *);
+void rwlock_release_read(struct rwlock *);
+void rwlock_acquire_write(struct rwlock *);
+void rwlock_release_write(struct rwlock *);
+bool rwlock_tryupgrade(struct rwlock *);
+void rwlock_downgrade(struct rwlock *);
+bool rwlock_do_i_write(struct rwlock *);
+
+
+/*
+ * Countdown latch.
+ *
+ * Created with a count; latch_countdown takes one off it, and
+ * latch_wait blocks until it reaches zero. Once it has, it stays
+ * there: later latch_wait calls return at once, and counting down
+ * again is an error. Waiters are woken all together, exactly once,
+ * by whichever latch_countdown call reaches zero. The usual use is
+ * "wait for these N threads to finish".
+ *
+ * latch_countdown may be called from an interrupt handler.
+ *
+ * The name field is for easier debugging. A copy of the name is made
+ * internally.
+ */
+struct latch {
+        char *lt_name;
+        struct spinlock lt_lock;
+        struct wchan *lt_wchan;
+        volatile unsigned lt_count;
+};
+
+struct latch *latch_create(const char *name, unsigned count);
+void latch_destroy(struct latch *);
+
+/*
+ * Operations:
+ *    latch_countdown - Decrement the count; wake all waiters if it
+ *                      reaches zero.
+ *    latch_wait      - Block until the count is zero.
+ */
+void latch_countdown(struct latch *);
+void latch_wait(struct latch *);
+
+
+/*
+ * Barrier.
+ *
+ * A fixed number of threads (the "parties") meet at the barrier;
+ * each barrier_wait blocks until all of them have arrived, and the
+ * last to arrive wakes the rest all at once. The barrier then resets
+ * itself for the next round. barrier_wait returns true in exactly one
+ * of the threads of each round (the last one in) and false in the
+ * others, so one thread can be picked to do any work for the round.
+ *
+ * Woken threads don't touch the barrier again, so the thread that
+ * got true may destroy it once nobody will use it any more.
+ *
+ * The name field is for easier debugging. A copy of the name is made
+ * internally.
+ */
+struct barrier {
+        char *b_name;
+        struct spinlock b_lock;
+        struct wchan *b_wchan;
+        unsigned b_parties;             /* threads per round */
+        unsigned b_waiting;             /* arrived so far this round */
+        unsigned b_rounds;              /* completed rounds */
+};
+
+struct barrier *barrier_create(const char *name, unsigned parties);
+void barrier_destroy(struct barrier *);
+bool barrier_wait(struct barrier *);
+
+
 #endif /* _SYNCH_H_ */
@@ -52,6 +52,9 @@ void enter_forked_process(void *tf, unsigned long n);
 void enter_new_process(int argc, userptr_t argv, vaddr_t stackptr,
 		       		   vaddr_t entrypoint);
 
+/* Enter user mode in a thread from thread_create. Does not return. */
+void enter_user_thread(vaddr_t entrypoint, vaddr_t arg, vaddr_t stackptr);
+
 
 /*
  * Prototypes for IN-KERNEL entry points for system call implementations.
@@ -59,6 +62,8 @@ void enter_new_process(int argc, userptr_t argv, vaddr_t stackptr,
 
 int sys_reboot(int code);
 int sys___time(userptr_t user_seconds, userptr_t user_nanoseconds);
+int sys_futex_wait(userptr_t uaddr, uint32_t val);
+int sys_futex_wake(userptr_t uaddr, int n, int *retval);
 
 #ifdef UW
 int sys_write(int fdesc, userptr_t ubuf, unsigned int nbytes, int *retval);
@@ -74,6 +79,22 @@ int sys_waitpid(pid_t pid, userptr_t status, int options, pid_t *retval);
 	// ASST2b
 	int sys_execv(char *progname, char **argv);
 #endif
+#if OPT_A2
+	int sys_open(userptr_t path, int flags, mode_t mode, int *retval);
+	int sys_read(int fdesc, userptr_t ubuf, unsigned int nbytes, int *retval);
+	int sys_lseek(int fdesc, off_t pos, int whence, off_t *retval);
+	int sys_close(int fdesc);
+	int sys_dup2(int oldfd, int newfd, int *retval);
+#endif
+#if OPT_A2
+	int sys_thread_create(userptr_t func, userptr_t arg, userptr_t stack,
+			      int *retval);
+	void sys_thread_exit(int retval);
+	int sys_thread_join(int tid, userptr_t retvalp);
+
+	/* Leave the process if it's exiting; call on the way to user mode */
+	void proc_exitcheck(void);
+#endif
 
 #endif // UW
 
@@ -54,14 +54,23 @@ int traffic_simulation(int, char **);
 int arraytest(int, char **);
 int bitmaptest(int, char **);
 int queuetest(int, char **);
+int lockfreetest(int, char **);
 
 /* thread tests */
 int threadtest(int, char **);
 int threadtest2(int, char **);
 int threadtest3(int, char **);
+int threadbench(int, char **);
+int ipistress(int, char **);
 int semtest(int, char **);
 int locktest(int, char **);
 int cvtest(int, char **);
+int lockbench(int, char **);
+int lockconvoy(int, char **);
+int rwtest(int, char **);
+int spinbench(int, char **);
+int wqtest(int, char **);
+int rttest(int, char **);
 
 #ifdef UW
 /* Another thread and synchronization test */
@@ -41,6 +41,7 @@
 #include <threadlist.h>
 
 struct cpu;
+struct uthread;
 
 /* get machine-dependent defs */
 #include <machine/thread.h>
@@ -49,6 +50,9 @@ struct cpu;
 /* Size of kernel stacks; must be power of 2 */
 #define STACK_SIZE 4096
 
+/* Names shorter than this are stored in the thread itself */
+#define THREAD_NAMELEN 16
+
 /* Mask for extracting the stack base address of a kernel stack pointer */
 #define STACK_MASK  (~(vaddr_t)(STACK_SIZE-1))
 
@@ -71,6 +75,7 @@ struct thread {
 	 * debugger is messed up.
 	 */
 	char *t_name;			/* Name of this thread */
+	char t_namebuf[THREAD_NAMELEN];	/* t_name points here if it fits */
 	const char *t_wchan_name;	/* Name of wait channel, if sleeping */
 	threadstate_t t_state;		/* State this thread is in */
 
@@ -82,7 +87,31 @@ struct thread {
 	void *t_stack;			/* Kernel-level stack */
 	struct switchframe *t_context;	/* Saved register context (on stack) */
 	struct cpu *t_cpu;		/* CPU thread runs on */
+	bool t_pinned;			/* Never migrate off t_cpu */
 	struct proc *t_proc;		/* Process thread belongs to */
+	struct uthread *t_uthread;	/* thread_create record, or NULL */
+
+	/*
+	 * Scheduling class fields; see thread_setsched. Protected by
+	 * the runqueue lock of t_cpu.
+	 */
+	int t_schedclass;		/* THREAD_SCHED_* */
+	unsigned t_rtprio;		/* Real-time priority */
+	unsigned t_rtutil;		/* Admitted utilization, per mille */
+
+	/*
+	 * Scheduling statistics; see thread_printstats. Times are in
+	 * usec. t_stamp is when the thread last started running if
+	 * it is running, or when it was queued if it is ready.
+	 */
+	uint64_t t_stamp;		/* Start of the current interval */
+	uint64_t t_runtime;		/* Time spent running */
+	uint64_t t_waittime;		/* Time spent ready but not running */
+	unsigned t_nvcsw;		/* Switches from sleeping or yielding */
+	unsigned t_nivcsw;		/* Switches from being preempted */
+	unsigned t_nmigrations;		/* Moves to another cpu */
+	struct thread *t_allprev;	/* Links for the list of all threads */
+	struct thread *t_allnext;
 
 	/*
 	 * Interrupt state fields.
@@ -144,12 +173,38 @@ int thread_fork(const char *name, struct proc *proc,
                 void (*func)(void *, unsigned long),
                 void *data1, unsigned long data2);
 
+/*
+ * Like thread_fork, but the new thread runs on cpu number CPUNUM and
+ * is never migrated to another cpu. For per-cpu service threads.
+ */
+int thread_fork_oncpu(const char *name, struct proc *proc, unsigned cpunum,
+                      void (*func)(void *, unsigned long),
+                      void *data1, unsigned long data2);
+
 /*
  * Cause the current thread to exit.
  * Interrupts need not be disabled.
  */
 void thread_exit(void);
 
+/*
+ * Exited threads are not freed right away; each cpu keeps up to
+ * thread_cache_max of them (with their stacks) for thread_fork to
+ * reuse. 0 turns the cache off.
+ */
+#define THREAD_CACHE_MAX_DEFAULT  16
+extern unsigned thread_cache_max;
+
+/*
+ * Zombies aren't reaped on every context switch, but once a cpu has
+ * thread_reap_batch of them (or thread_fork finds the cache empty).
+ * Those that don't fit in the cache are freed later by a work item
+ * on system_wq instead of in the middle of the switch. 1 reaps on
+ * every switch, as it used to.
+ */
+#define THREAD_REAP_BATCH_DEFAULT  8
+extern unsigned thread_reap_batch;
+
 /*
  * Cause the current thread to yield to the next runnable thread, but
  * itself stay runnable.
@@ -157,6 +212,57 @@ void thread_exit(void);
  */
 void thread_yield(void);
 
+/*
+ * Directed yield: if thread T is ready to run but queued, move it to
+ * the front of its cpu's run queue and make that cpu reschedule, so
+ * it runs next. Returns false if T wasn't found waiting on a normal
+ * run queue (it's running, asleep, real-time, or being migrated).
+ */
+bool thread_boost(struct thread *t);
+
+/*
+ * Called from hardclock in place of thread_yield; skips the context
+ * switch attempt when nothing else is runnable on this cpu.
+ */
+void thread_timeryield(void);
+
+/*
+ * Scheduling classes.
+ *
+ * Threads start out in THREAD_SCHED_NORMAL and share their cpu's
+ * FIFO run queue. Threads in THREAD_SCHED_RT go on the cpu's
+ * real-time queue instead, which is always served first, highest
+ * priority first and round-robin within a priority. A real-time
+ * thread is not preempted by the timer in favor of normal threads,
+ * preempts a lower-ranked running thread as soon as it wakes up,
+ * and is never migrated.
+ *
+ * thread_setsched moves the current thread into class SCHEDCLASS.
+ * For THREAD_SCHED_RT, PRIO (0 to THREAD_RT_MAXPRIO, higher runs
+ * first) picks the priority, and BUDGET and PERIOD say how many
+ * usec of cpu the thread needs every PERIOD usec. The call fails
+ * with EBUSY if that would push the cpu's total real-time
+ * utilization past thread_rt_maxutil (per mille). The default is
+ * the rate-monotonic bound: if priorities are assigned by period,
+ * shorter periods higher, every admitted thread meets its
+ * deadlines. Budgets are declared, not enforced. The other
+ * arguments are ignored for THREAD_SCHED_NORMAL.
+ */
+#define THREAD_SCHED_NORMAL	0
+#define THREAD_SCHED_RT		1
+#define THREAD_RT_MAXPRIO	99
+#define THREAD_RT_MAXUTIL_DEFAULT  690
+extern unsigned thread_rt_maxutil;
+
+int thread_setsched(int schedclass, unsigned prio,
+		    uint32_t budget, uint32_t period);
+
+/*
+ * Print every thread's state and scheduling statistics, and each
+ * cpu's idle time.
+ */
+void thread_printstats(void);
+
 /*
  * Reshuffle the run queue. Called from the timer interrupt.
  */
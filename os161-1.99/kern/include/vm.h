@@ -51,6 +51,14 @@ void vm_bootstrap(void);
 /* Fault handling function called by trap code */
 int vm_fault(int faulttype, vaddr_t faultaddress);
 
+/*
+ * Look up the physical address VADDR is mapped to in the current
+ * process's address space. Returns EFAULT if it isn't mapped. The
+ * result is only good as long as the mapping is (for dumbvm, the
+ * life of the address space).
+ */
+int vm_translate(vaddr_t vaddr, paddr_t *paddr);
+
 /* Allocate/free kernel heap pages (called by kmalloc/kfree) */
 vaddr_t alloc_kpages(int npages);
 void free_kpages(vaddr_t addr);
@@ -47,12 +47,16 @@ struct stat;
  *
  * Note: vn_fs may be null if the vnode refers to a device.
  *
+ * vn_refcount is managed using VOP_INCREF and VOP_DECREF, with the
+ * operations in <atomic.h>; anything else that touches it must use
+ * those too.
+ *
  * vn_opencount is managed using VOP_INCOPEN and VOP_DECOPEN by
  * vfs_open() and vfs_close(). Code above the VFS layer should not
  * need to worry about it.
  */
 struct vnode {
-	int vn_refcount;                /* Reference count */
+	volatile unsigned vn_refcount;  /* Reference count */
 	int vn_opencount;
 
 	struct fs *vn_fs;               /* Filesystem vnode belongs to */
@@ -36,6 +36,7 @@
 
 
 struct wchan; /* Opaque */
+struct thread; /* from <thread.h> */
 
 /*
  * Create a wait channel. Use NAME as a symbolic name for the channel.
@@ -81,5 +82,22 @@ void wchan_sleep(struct wchan *wc);
 void wchan_wakeone(struct wchan *wc);
 void wchan_wakeall(struct wchan *wc);
 
+/*
+ * Like wchan_wakeone, but return the thread that was woken (or NULL
+ * if nobody was sleeping), so the caller can hand something directly
+ * to it. The caller must hold whatever protects the thing being
+ * handed over, or the thread may look at it before the handoff is
+ * complete.
+ */
+struct thread *wchan_wakeone_thread(struct wchan *wc);
+
+/*
+ * Move all threads sleeping on FROM onto the end of TO without waking
+ * them; they are woken by whoever next wakes up TO. Neither channel
+ * should be locked. FROM is locked before TO, so two channels must
+ * always be requeued in the same direction.
+ */
+void wchan_requeue(struct wchan *from, struct wchan *to);
+
 
 #endif /* _WCHAN_H_ */
@@ -0,0 +1,114 @@
+/*
+ * Copyright (c) 2000, 2001, 2002, 2003, 2004, 2005, 2008, 2009
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#ifndef _WORKQUEUE_H_
+#define _WORKQUEUE_H_
+
+/*
+ * Workqueues: deferred work run by persistent kernel threads.
+ *
+ * A workqueue has one worker thread per cpu, pinned to that cpu.
+ * Work items queued on a cpu run on that cpu's worker, one at a
+ * time, in the order they were queued. This gives code that wants to
+ * do something later (or somewhere it's allowed to sleep) a home,
+ * without paying for a thread_fork and a fresh stack every time.
+ *
+ * system_wq is a general-purpose queue created at boot.
+ */
+
+#include <spinlock.h>
+
+struct workqueue;	/* Opaque. */
+struct wq_cpu;		/* Opaque; per-cpu part of a workqueue. */
+
+/*
+ * Work item. Allocated by the caller, often embedded in some other
+ * structure; set up with work_init. The fields are private to the
+ * workqueue code.
+ *
+ * The function is called with the two data arguments, in the
+ * worker thread, with no locks held. Once it has been called, the
+ * workqueue code no longer touches the item, so the function may
+ * free it or queue it again.
+ */
+struct work {
+	void (*w_func)(void *data1, unsigned long data2);
+	void *w_data1;
+	unsigned long w_data2;
+
+	volatile spinlock_data_t w_pending; /* queued and not yet run */
+	struct wq_cpu *w_cpu;		/* cpu last queued on */
+	bool w_onlist;			/* on w_cpu's list */
+	struct work *w_prev;		/* list linkage */
+	struct work *w_next;
+	uint64_t w_queuedat;		/* gettime_usec() when queued */
+};
+
+void work_init(struct work *w, void (*func)(void *, unsigned long),
+	       void *data1, unsigned long data2);
+
+/*
+ * Functions:
+ *    workqueue_create   - make a queue and start its worker threads.
+ *                         NAME is used for the threads. Call only
+ *                         after thread_start_cpus. Returns NULL on
+ *                         error.
+ *    workqueue_destroy  - run everything still queued, then stop the
+ *                         workers and free the queue.
+ *    workqueue_queue    - queue W on the current cpu. Returns false
+ *                         (and does nothing) if W is already queued.
+ *                         May be called from interrupt handlers.
+ *    workqueue_queue_on - same, but on cpu number CPUNUM.
+ *    workqueue_cancel   - take W off the queue if it hasn't started
+ *                         yet and return true. Otherwise, wait for
+ *                         it to finish if it's running, and return
+ *                         false. May sleep.
+ *    workqueue_flush    - wait until everything queued on any cpu
+ *                         before the call has run. May sleep.
+ *    workqueue_printstats - print per-cpu counts and queueing
+ *                         latency (time from queued to started).
+ *
+ * A work function must not flush or destroy its own queue.
+ */
+struct workqueue *workqueue_create(const char *name);
+void workqueue_destroy(struct workqueue *wq);
+bool workqueue_queue(struct workqueue *wq, struct work *w);
+bool workqueue_queue_on(struct workqueue *wq, unsigned cpunum,
+			struct work *w);
+bool workqueue_cancel(struct workqueue *wq, struct work *w);
+void workqueue_flush(struct workqueue *wq);
+void workqueue_printstats(struct workqueue *wq);
+
+/* Create system_wq. Called from boot(). */
+void workqueue_bootstrap(void);
+
+extern struct workqueue *system_wq;
+
+
+#endif /* _WORKQUEUE_H_ */
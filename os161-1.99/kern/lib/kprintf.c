@@ -72,18 +72,45 @@ kprintf_bootstrap(void)
 }
 
 /*
- * Send characters to the console. Backend for __printf.
+ * Send characters to the console. Backend for __printf. __printf
+ * hands over literal text a character at a time, so collect it and
+ * pass it to putbuf in runs; the console can then queue each run in
+ * one go instead of taking its locks once per character.
  */
+#define KPRINTF_BUFSIZE  128
+
+struct kprintf_buf {
+	char kb_data[KPRINTF_BUFSIZE];
+	size_t kb_len;
+};
+
 static
 void
-console_send(void *junk, const char *data, size_t len)
+console_flush(struct kprintf_buf *kb)
 {
-	size_t i;
-
-	(void)junk;
+	putbuf(kb->kb_data, kb->kb_len);
+	kb->kb_len = 0;
+}
 
-	for (i=0; i<len; i++) {
-		putch(data[i]);
+static
+void
+console_send(void *vkb, const char *data, size_t len)
+{
+	struct kprintf_buf *kb = vkb;
+	size_t n;
+
+	while (len > 0) {
+		n = KPRINTF_BUFSIZE - kb->kb_len;
+		if (n > len) {
+			n = len;
+		}
+		memcpy(kb->kb_data + kb->kb_len, data, n);
+		kb->kb_len += n;
+		data += n;
+		len -= n;
+		if (kb->kb_len == KPRINTF_BUFSIZE) {
+			console_flush(kb);
+		}
 	}
 }
 
@@ -96,6 +123,7 @@ kprintf(const char *fmt, ...)
 	int chars;
 	va_list ap;
 	bool dolock;
+	struct kprintf_buf kb;
 
 	dolock = kprintf_lock != NULL
 		&& curthread->t_in_interrupt == false
@@ -109,9 +137,11 @@ kprintf(const char *fmt, ...)
 	}
 	putch_prepare();
 
+	kb.kb_len = 0;
 	va_start(ap, fmt);
-	chars = __vprintf(console_send, NULL, fmt, ap);
+	chars = __vprintf(console_send, &kb, fmt, ap);
 	va_end(ap);
+	console_flush(&kb);
 
 	putch_complete();
 	if (dolock) {
@@ -133,6 +163,7 @@ void
 panic(const char *fmt, ...)
 {
 	va_list ap;
+	struct kprintf_buf kb;
 
 	/*
 	 * When we reach panic, the system is usually fairly screwed up.
@@ -172,9 +203,11 @@ panic(const char *fmt, ...)
 		/* Print the message. */
 		kprintf("panic: ");
 		putch_prepare();
+		kb.kb_len = 0;
 		va_start(ap, fmt);
-		__vprintf(console_send, NULL, fmt, ap);
+		__vprintf(console_send, &kb, fmt, ap);
 		va_end(ap);
+		console_flush(&kb);
 		putch_complete();
 	}
 
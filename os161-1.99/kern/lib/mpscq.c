@@ -0,0 +1,134 @@
+/*
+ * Copyright (c) 2000, 2001
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/*
+ * Bounded lock-free MPSC queue. See mpscq.h.
+ */
+
+#include <types.h>
+#include <lib.h>
+#include <spl.h>
+#include <atomic.h>
+#include <mpscq.h>
+
+void
+mpscq_init(struct mpscq *mq, struct mpscq_slot *slots, unsigned size)
+{
+	unsigned i;
+
+	KASSERT(size > 0 && (size & (size - 1)) == 0);
+
+	for (i=0; i<size; i++) {
+		slots[i].ms_seq = i;
+		slots[i].ms_ptr = NULL;
+	}
+	mq->mq_slots = slots;
+	mq->mq_mask = size - 1;
+	mq->mq_tail = 0;
+	mq->mq_head = 0;
+}
+
+bool
+mpscq_put(struct mpscq *mq, void *ptr)
+{
+	struct mpscq_slot *ms;
+	unsigned pos, seq, seen;
+	int spl;
+
+	KASSERT(ptr != NULL);
+
+	/*
+	 * Interrupts off, so we aren't switched out between claiming
+	 * a slot and publishing it; the consumer can't get past an
+	 * unpublished slot.
+	 */
+	spl = splhigh();
+
+	pos = atomic_load(&mq->mq_tail);
+	while (1) {
+		ms = &mq->mq_slots[pos & mq->mq_mask];
+		seq = atomic_load(&ms->ms_seq);
+		membar_consumer();
+		if (seq == pos) {
+			/* Free and ours if nobody claims it first. */
+			seen = atomic_cas(&mq->mq_tail, pos, pos + 1);
+			if (seen == pos) {
+				break;
+			}
+			pos = seen;
+		}
+		else if ((int)(seq - pos) < 0) {
+			/* Still holds an item from a lap ago: full. */
+			splx(spl);
+			return false;
+		}
+		else {
+			/* Someone else claimed it; catch up. */
+			pos = atomic_load(&mq->mq_tail);
+		}
+	}
+
+	atomic_storeptr(&ms->ms_ptr, ptr);
+	membar_producer();
+	atomic_store(&ms->ms_seq, pos + 1);
+
+	splx(spl);
+	return true;
+}
+
+void *
+mpscq_get(struct mpscq *mq)
+{
+	struct mpscq_slot *ms;
+	unsigned pos;
+	void *ptr;
+
+	pos = mq->mq_head;
+	ms = &mq->mq_slots[pos & mq->mq_mask];
+	if (atomic_load(&ms->ms_seq) != pos + 1) {
+		return NULL;
+	}
+	membar_consumer();
+	ptr = atomic_loadptr(&ms->ms_ptr);
+
+	/* Done reading the slot; hand it to the producer a lap on. */
+	membar_any_any();
+	atomic_store(&ms->ms_seq, pos + mq->mq_mask + 1);
+	mq->mq_head = pos + 1;
+	return ptr;
+}
+
+bool
+mpscq_empty(struct mpscq *mq)
+{
+	struct mpscq_slot *ms;
+
+	ms = &mq->mq_slots[mq->mq_head & mq->mq_mask];
+	return atomic_load(&ms->ms_seq) != mq->mq_head + 1;
+}
@@ -0,0 +1,141 @@
+/*
+ * Copyright (c) 2000, 2001, 2002, 2003, 2004, 2005, 2008, 2009
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/*
+ * Per-cpu counters. See pcpu_counter.h.
+ */
+
+#include <types.h>
+#include <lib.h>
+#include <spl.h>
+#include <cpu.h>
+#include <current.h>
+#include <pcpu_counter.h>
+
+void
+pcpu_counter_init(struct pcpu_counter *pc, unsigned batch)
+{
+	unsigned i;
+
+	spinlock_init(&pc->pc_lock);
+	pc->pc_total = 0;
+	pc->pc_batch = batch > 0 ? batch : PCPU_COUNTER_BATCH;
+	for (i=0; i<PCPU_COUNTER_MAXCPUS; i++) {
+		pc->pc_slots[i].pcs_delta = 0;
+	}
+}
+
+void
+pcpu_counter_cleanup(struct pcpu_counter *pc)
+{
+	spinlock_cleanup(&pc->pc_lock);
+}
+
+void
+pcpu_counter_add(struct pcpu_counter *pc, int32_t delta)
+{
+	struct pcpu_counter_slot *slot;
+	int32_t val;
+	int spl;
+
+	/*
+	 * Stay on this cpu, and keep our own interrupt handlers out,
+	 * while we update the slot. No other cpu writes it.
+	 */
+	spl = splhigh();
+	KASSERT(curcpu->c_number < PCPU_COUNTER_MAXCPUS);
+	slot = &pc->pc_slots[curcpu->c_number];
+	val = slot->pcs_delta + delta;
+	if (val >= (int32_t)pc->pc_batch || val <= -(int32_t)pc->pc_batch) {
+		spinlock_acquire(&pc->pc_lock);
+		pc->pc_total += val;
+		slot->pcs_delta = 0;
+		spinlock_release(&pc->pc_lock);
+	}
+	else {
+		slot->pcs_delta = val;
+	}
+	splx(spl);
+}
+
+void
+pcpu_counter_inc(struct pcpu_counter *pc)
+{
+	pcpu_counter_add(pc, 1);
+}
+
+int64_t
+pcpu_counter_read(struct pcpu_counter *pc)
+{
+	int64_t ret;
+
+	/* Locked only so the 64-bit read can't tear. */
+	spinlock_acquire(&pc->pc_lock);
+	ret = pc->pc_total;
+	spinlock_release(&pc->pc_lock);
+	return ret;
+}
+
+int64_t
+pcpu_counter_sum(struct pcpu_counter *pc)
+{
+	int64_t ret;
+	unsigned i, n;
+
+	/*
+	 * Holding pc_lock stops deltas from being folded in, so none
+	 * can be counted twice or missed; an update on another cpu
+	 * that lands in its slot while we're looking is simply
+	 * ordered before or after the sum.
+	 */
+	n = cpu_count();
+	if (n > PCPU_COUNTER_MAXCPUS) {
+		n = PCPU_COUNTER_MAXCPUS;
+	}
+	spinlock_acquire(&pc->pc_lock);
+	ret = pc->pc_total;
+	for (i=0; i<n; i++) {
+		ret += pc->pc_slots[i].pcs_delta;
+	}
+	spinlock_release(&pc->pc_lock);
+	return ret;
+}
+
+void
+pcpu_counter_reset(struct pcpu_counter *pc)
+{
+	unsigned i;
+
+	spinlock_acquire(&pc->pc_lock);
+	pc->pc_total = 0;
+	for (i=0; i<PCPU_COUNTER_MAXCPUS; i++) {
+		pc->pc_slots[i].pcs_delta = 0;
+	}
+	spinlock_release(&pc->pc_lock);
+}
@@ -0,0 +1,128 @@
+/*
+ * Copyright (c) 2000, 2001
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/*
+ * Lock-free SPSC byte ring. See spscring.h.
+ */
+
+#include <types.h>
+#include <lib.h>
+#include <atomic.h>
+#include <spscring.h>
+
+void
+spscring_init(struct spscring *sr, char *buf, unsigned size)
+{
+	KASSERT(size > 0 && (size & (size - 1)) == 0);
+
+	sr->sr_buf = buf;
+	sr->sr_mask = size - 1;
+	sr->sr_head = 0;
+	sr->sr_tail = 0;
+}
+
+unsigned
+spscring_used(struct spscring *sr)
+{
+	return atomic_load(&sr->sr_tail) - atomic_load(&sr->sr_head);
+}
+
+unsigned
+spscring_space(struct spscring *sr)
+{
+	return sr->sr_mask + 1 - spscring_used(sr);
+}
+
+/*
+ * Where a LEN-byte region at ring position POS starts, and how much of
+ * it comes before the end of the buffer; the rest wraps to the start.
+ */
+static
+unsigned
+spscring_split(struct spscring *sr, unsigned pos, size_t len, size_t *first)
+{
+	unsigned off;
+
+	off = pos & sr->sr_mask;
+	*first = sr->sr_mask + 1 - off;
+	if (*first > len) {
+		*first = len;
+	}
+	return off;
+}
+
+size_t
+spscring_write(struct spscring *sr, const void *data, size_t len)
+{
+	unsigned tail, space, off;
+	size_t first;
+
+	tail = sr->sr_tail;
+	space = sr->sr_mask + 1 - (tail - atomic_load(&sr->sr_head));
+	if (len > space) {
+		len = space;
+	}
+	if (len == 0) {
+		return 0;
+	}
+
+	/* Don't overwrite bytes until the consumer is done with them. */
+	membar_any_any();
+	off = spscring_split(sr, tail, len, &first);
+	memcpy(sr->sr_buf + off, data, first);
+	memcpy(sr->sr_buf, (const char *)data + first, len - first);
+	membar_producer();
+	atomic_store(&sr->sr_tail, tail + len);
+	return len;
+}
+
+size_t
+spscring_read(struct spscring *sr, void *data, size_t len)
+{
+	unsigned head, used, off;
+	size_t first;
+
+	head = sr->sr_head;
+	used = atomic_load(&sr->sr_tail) - head;
+	if (len > used) {
+		len = used;
+	}
+	if (len == 0) {
+		return 0;
+	}
+
+	membar_consumer();
+	off = spscring_split(sr, head, len, &first);
+	memcpy(data, sr->sr_buf + off, first);
+	memcpy((char *)data + first, sr->sr_buf, len - first);
+	/* Done reading before the producer may reuse the space. */
+	membar_any_any();
+	atomic_store(&sr->sr_head, head + len);
+	return len;
+}
@@ -55,6 +55,7 @@
 #if OPT_A2
 	// ASST2a
 	#include <limits.h>
+	#include <file.h>
 #endif
 
 /*
@@ -74,13 +75,160 @@ static struct semaphore *proc_count_mutex;
 /* used to signal the kernel menu thread when there are no processes */
 struct semaphore *no_proc_sem;
 
+#endif  // UW
+
 #if OPT_A2
-	// ASST2a
-	static volatile unsigned int pid_count;
-	static struct semaphore *pid_count_mutex;
-#endif
+struct lock *proc_familylock;
 
-#endif  // UW
+/*
+ * PID table.
+ *
+ * A bitmap says which PIDs are taken, and a two-level table maps
+ * each PID to its proc: a fixed array of pointers to leaves of
+ * PIDTAB_LEAFSIZE entries, each allocated the first time a PID in
+ * its range is handed out (and kept after that). PIDs are given out
+ * next-fit, starting after the last one allocated, so a PID isn't
+ * reused until the rest of the space has been gone through. Both
+ * allocation and lookup are a short critical section under a
+ * spinlock, so neither sleeps.
+ *
+ * A PID is allocated in proc_create_runprogram and freed when the
+ * proc is destroyed, which is once it has exited and its parent has
+ * collected it or gone away.
+ */
+#define PIDTAB_LEAFSIZE  256
+#define PIDTAB_NLEAVES   ((PID_MAX + 1) / PIDTAB_LEAFSIZE)
+#define PIDMAP_NWORDS    ((PID_MAX + 1) / 32)
+
+static struct proc **pidtab[PIDTAB_NLEAVES];
+static uint32_t pidmap[PIDMAP_NWORDS];
+static pid_t pid_next;		/* where the next search starts */
+static struct spinlock pid_lock;
+
+static
+void
+pid_bootstrap(void)
+{
+	pid_t pid;
+
+	spinlock_init(&pid_lock);
+	/* PIDs below PID_MIN are never handed out */
+	for (pid = 0; pid < PID_MIN; pid++) {
+		pidmap[pid / 32] |= (uint32_t)1 << (pid % 32);
+	}
+	pid_next = PID_MIN;
+}
+
+/*
+ * Give PROC a PID. Returns 0 if there are none left (or no memory
+ * for a new leaf).
+ */
+static
+pid_t
+pid_alloc(struct proc *proc)
+{
+	struct proc **leaf, **spare;
+	uint32_t bits;
+	unsigned i, w, b;
+	pid_t pid;
+
+	spinlock_acquire(&pid_lock);
+
+	/*
+	 * Scan a word at a time from pid_next, treating the PIDs
+	 * before pid_next in its word as taken. Going one word past
+	 * the full circle comes back to that word to look at them.
+	 */
+	pid = 0;
+	for (i = 0; i <= PIDMAP_NWORDS; i++) {
+		w = (pid_next / 32 + i) % PIDMAP_NWORDS;
+		bits = pidmap[w];
+		if (i == 0) {
+			bits |= ((uint32_t)1 << (pid_next % 32)) - 1;
+		}
+		if (bits == 0xffffffff) {
+			continue;
+		}
+		for (b = 0; bits & ((uint32_t)1 << b); b++) {
+			/* nothing */
+		}
+		pid = w * 32 + b;
+		break;
+	}
+	if (pid == 0) {
+		spinlock_release(&pid_lock);
+		return 0;
+	}
+	pidmap[pid / 32] |= (uint32_t)1 << (pid % 32);
+	pid_next = (pid == PID_MAX) ? PID_MIN : pid + 1;
+
+	if (pidtab[pid / PIDTAB_LEAFSIZE] == NULL) {
+		/*
+		 * The PID is ours, so nobody else will touch its slot;
+		 * drop the lock to get memory for the leaf. Someone
+		 * else may install the same leaf meanwhile.
+		 */
+		spinlock_release(&pid_lock);
+		leaf = kmalloc(PIDTAB_LEAFSIZE * sizeof(*leaf));
+		spinlock_acquire(&pid_lock);
+		if (leaf == NULL && pidtab[pid / PIDTAB_LEAFSIZE] == NULL) {
+			pidmap[pid / 32] &= ~((uint32_t)1 << (pid % 32));
+			spinlock_release(&pid_lock);
+			return 0;
+		}
+		spare = NULL;
+		if (pidtab[pid / PIDTAB_LEAFSIZE] == NULL) {
+			for (i = 0; i < PIDTAB_LEAFSIZE; i++) {
+				leaf[i] = NULL;
+			}
+			pidtab[pid / PIDTAB_LEAFSIZE] = leaf;
+		}
+		else {
+			spare = leaf;
+		}
+		pidtab[pid / PIDTAB_LEAFSIZE][pid % PIDTAB_LEAFSIZE] = proc;
+		spinlock_release(&pid_lock);
+		if (spare != NULL) {
+			kfree(spare);
+		}
+		return pid;
+	}
+
+	pidtab[pid / PIDTAB_LEAFSIZE][pid % PIDTAB_LEAFSIZE] = proc;
+	spinlock_release(&pid_lock);
+	return pid;
+}
+
+static
+void
+pid_free(pid_t pid)
+{
+	KASSERT(pid >= PID_MIN && pid <= PID_MAX);
+
+	spinlock_acquire(&pid_lock);
+	KASSERT(pidmap[pid / 32] & ((uint32_t)1 << (pid % 32)));
+	pidtab[pid / PIDTAB_LEAFSIZE][pid % PIDTAB_LEAFSIZE] = NULL;
+	pidmap[pid / 32] &= ~((uint32_t)1 << (pid % 32));
+	spinlock_release(&pid_lock);
+}
+
+struct proc *
+proc_lookup(pid_t pid)
+{
+	struct proc **leaf;
+	struct proc *proc;
+
+	if (pid < PID_MIN || pid > PID_MAX) {
+		return NULL;
+	}
+
+	spinlock_acquire(&pid_lock);
+	leaf = pidtab[pid / PIDTAB_LEAFSIZE];
+	proc = (leaf == NULL) ? NULL : leaf[pid % PIDTAB_LEAFSIZE];
+	spinlock_release(&pid_lock);
+	return proc;
+}
+#endif /* OPT_A2 */
 
 
 
@@ -110,18 +258,34 @@ static struct proc *proc_create(const char *name) {
 	proc->p_cwd = NULL;
 
 #ifdef UW
+	#if OPT_A2
+		for (int i = 0; i < OPEN_MAX; i++) {
+			proc->p_fds[i] = NULL;
+		}
+	#else
 	proc->console = NULL;
+	#endif
 #endif // UW
 
 	#if OPT_A2
 		// ASST2a
-		proc->p_children = array_create();
+		proc->p_pid = 0;
 		proc->p_parent = NULL;
+		proc->p_livechildren = NULL;
+		proc->p_deadchildren = NULL;
+		proc->p_sibprev = NULL;
+		proc->p_sibnext = NULL;
 		proc->p_exitcode = 0;
 		proc->p_exitstatus = 0;
+		proc->p_childcv = cv_create("proc child cv");
 
 		proc->p_lck = lock_create("proc cv lck");
-		proc->p_cv = cv_create("proc cv");
+
+		proc->p_uthreads = NULL;
+		proc->p_nexttid = 1;
+		proc->p_threadcv = cv_create("proc thread cv");
+		proc->p_exiting = false;
+		proc->p_exitpending = 0;
 	#endif
 
 	return proc;
@@ -149,6 +313,27 @@ void proc_destroy(struct proc *proc) {
 	 * incorrect to destroy it.)
 	 */
 
+	#if OPT_A2
+		/*
+		 * Give up the PID first. waitpid looks procs up by PID
+		 * under proc_familylock, so doing this under the lock
+		 * means nobody can be looking at the proc afterwards.
+		 */
+		if (proc->p_pid != 0) {
+			bool held = lock_do_i_hold(proc_familylock);
+
+			if (!held) {
+				lock_acquire(proc_familylock);
+			}
+			pid_free(proc->p_pid);
+			if (!held) {
+				lock_release(proc_familylock);
+			}
+		}
+		KASSERT(proc->p_livechildren == NULL);
+		KASSERT(proc->p_deadchildren == NULL);
+	#endif
+
 	/* VFS fields */
 	if (proc->p_cwd) {
 		VOP_DECREF(proc->p_cwd);
@@ -177,16 +362,28 @@ void proc_destroy(struct proc *proc) {
 #endif // UW
 
 #ifdef UW
+	#if OPT_A2
+		/* normally already done when the process exited */
+		fdtable_closeall(proc);
+	#else
 	if (proc->console) {
 	  vfs_close(proc->console);
 	}
+	#endif
 #endif // UW
 
 	#if OPT_A2
 		// ASST2a
-		array_destroy(proc->p_children);
+		cv_destroy(proc->p_childcv);
 		lock_destroy(proc->p_lck);
-		cv_destroy(proc->p_cv);
+
+		/* threads nobody joined */
+		while (proc->p_uthreads != NULL) {
+			struct uthread *ut = proc->p_uthreads;
+			proc->p_uthreads = ut->ut_next;
+			kfree(ut);
+		}
+		cv_destroy(proc->p_threadcv);
 	#endif
 
 	threadarray_cleanup(&proc->p_threads);
@@ -224,10 +421,10 @@ void proc_bootstrap(void) {
 #ifdef UW
 	#if OPT_A2
 		// ASST2a
-		pid_count = PID_MIN;
-		pid_count_mutex = sem_create("pid_count_mutex",1);
-		if (pid_count_mutex == NULL) {
-			panic("could not create pid_count_mutex semaphore\n");
+		pid_bootstrap();
+		proc_familylock = lock_create("proc_familylock");
+		if (proc_familylock == NULL) {
+			panic("could not create proc_familylock\n");
 		}
 	#endif
 	proc_count = 0;
@@ -251,7 +448,9 @@ void proc_bootstrap(void) {
  */
 struct proc *proc_create_runprogram(const char *name) {
 	struct proc *proc;
+#if !OPT_A2
 	char *console_path;
+#endif
 
 	proc = proc_create(name);
 	if (proc == NULL) {
@@ -259,6 +458,19 @@ struct proc *proc_create_runprogram(const char *name) {
 	}
 
 #ifdef UW
+	#if OPT_A2
+		/*
+		 * A forked child (the only other caller) inherits its
+		 * parent's descriptors; a program started from the menu
+		 * gets the console on 0, 1 and 2.
+		 */
+		if (curproc != kproc) {
+			fdtable_copy(curproc, proc);
+		}
+		else if (fdtable_console(proc)) {
+			panic("unable to open the console during process creation\n");
+		}
+	#else
 	/* open the console - this should always succeed */
 	console_path = kstrdup("con:");
 	if (console_path == NULL) {
@@ -268,6 +480,7 @@ struct proc *proc_create_runprogram(const char *name) {
 	  panic("unable to open the console during process creation\n");
 	}
 	kfree(console_path);
+	#endif
 #endif // UW
 	  
 	/* VM fields */
@@ -304,10 +517,11 @@ struct proc *proc_create_runprogram(const char *name) {
 
 	#if OPT_A2
 		// ASST2a
-		P(pid_count_mutex);
-		proc->p_pid = pid_count;
-		pid_count++;
-		V(pid_count_mutex);
+		proc->p_pid = pid_alloc(proc);
+		if (proc->p_pid == 0) {
+			proc_destroy(proc);
+			return NULL;
+		}
 	#endif
 
 	return proc;
@@ -334,9 +548,11 @@ int proc_addthread(struct proc *proc, struct thread *t) {
 
 /*
  * Remove a thread from its process. Either the thread or the process
- * might or might not be current.
+ * might or might not be current. Returns how many threads are left;
+ * since that's decided under p_lock, exactly one of several threads
+ * leaving at once sees 0.
  */
-void proc_remthread(struct thread *t) {
+unsigned proc_remthread(struct thread *t) {
 	struct proc *proc;
 	unsigned i, num;
 
@@ -349,14 +565,16 @@ void proc_remthread(struct thread *t) {
 	for (i=0; i<num; i++) {
 		if (threadarray_get(&proc->p_threads, i) == t) {
 			threadarray_remove(&proc->p_threads, i);
+			num = threadarray_num(&proc->p_threads);
 			spinlock_release(&proc->p_lock);
 			t->t_proc = NULL;
-			return;
+			return num;
 		}
 	}
 	/* Did not find it. */
 	spinlock_release(&proc->p_lock);
 	panic("Thread (%p) has escaped from its process (%p)\n", t, proc);
+	return 0;
 }
 
 /*
@@ -38,6 +38,7 @@
 #include <thread.h>
 #include <proc.h>
 #include <synch.h>
+#include <lockstat.h>
 #include <vfs.h>
 #include <sfs.h>
 #include <syscall.h>
@@ -45,6 +46,7 @@
 #include "opt-synchprobs.h"
 #include "opt-sfs.h"
 #include "opt-net.h"
+#include "opt-lockstat.h"
 
 #include "opt-A0.h"
 #include "opt-A2.h"
@@ -375,6 +377,43 @@ static int cmd_kheapstats(int nargs, char **args) {
 	return 0;
 }
 
+/*
+ * Command for listing threads and cpu idle time.
+ */
+static int cmd_threadstats(int nargs, char **args) {
+	(void)nargs;
+	(void)args;
+
+	thread_printstats();
+
+	return 0;
+}
+
+#if OPT_LOCKSTAT
+/*
+ * Command for showing the most contended locks since the last reset.
+ */
+static int cmd_lockstat(int nargs, char **args) {
+	int max = 10;
+
+	if (nargs > 2) {
+		kprintf("Usage: ls [count]\n");
+		return EINVAL;
+	}
+	if (nargs == 2) {
+		max = atoi(args[1]);
+		if (max <= 0) {
+			kprintf("ls: count must be positive\n");
+			return EINVAL;
+		}
+	}
+
+	lockstat_dump(max);
+
+	return 0;
+}
+#endif
+
 ////////////////////////////////////////
 //
 // Menus.
@@ -430,17 +469,26 @@ static int cmd_opsmenu(int n, char **a) {
 static const char *testmenu[] = {
 	"[at]  Array test                    ",
 	"[bt]  Bitmap test                   ",
+	"[lf]  Lock-free queue test          ",
 	"[km1] Kernel malloc test            ",
 	"[km2] kmalloc stress test           ",
 	"[tt1] Thread test 1                 ",
 	"[tt2] Thread test 2                 ",
 	"[tt3] Thread test 3                 ",
+	"[tt4] Thread create benchmark       ",
+	"[tt5] IPI stress test               ",
 #if OPT_NET
 	"[net] Network test                  ",
 #endif
 	"[sy1] Semaphore test                ",
 	"[sy2] Lock test             (1)     ",
 	"[sy3] CV test               (1)     ",
+	"[sy4] Lock benchmark        (1)     ",
+	"[sy5] Rwlock test                   ",
+	"[sy6] Spinlock benchmark            ",
+	"[sy7] Lock convoy test              ",
+	"[wq]  Workqueue test                ",
+	"[rt]  Real-time latency test        ",
 #ifdef UW
 	"[uw1] UW lock test          (1)     ",
 	"[uw2] UW vmstats test       (3)     ",
@@ -478,6 +526,10 @@ static const char *mainmenu[] = {
 #endif /* UW */
 #endif
 	"[kh] Kernel heap stats              ",
+	"[ps] Thread and cpu stats           ",
+#if OPT_LOCKSTAT
+	"[ls] Lock contention stats          ",
+#endif
 	"[q] Quit and shut down              ",
 	NULL
 };
@@ -534,10 +586,15 @@ static struct {
 
 	/* stats */
 	{ "kh",         cmd_kheapstats },
+	{ "ps",         cmd_threadstats },
+#if OPT_LOCKSTAT
+	{ "ls",         cmd_lockstat },
+#endif
 
 	/* base system tests */
 	{ "at",		arraytest },
 	{ "bt",		bitmaptest },
+	{ "lf",		lockfreetest },
 	{ "km1",	malloctest },
 	{ "km2",	mallocstress },
 #if OPT_NET
@@ -546,11 +603,19 @@ static struct {
 	{ "tt1",	threadtest },
 	{ "tt2",	threadtest2 },
 	{ "tt3",	threadtest3 },
+	{ "tt4",	threadbench },
+	{ "tt5",	ipistress },
 	{ "sy1",	semtest },
 
 	/* synchronization assignment tests */
 	{ "sy2",	locktest },
 	{ "sy3",	cvtest },
+	{ "sy4",	lockbench },
+	{ "sy5",	rwtest },
+	{ "sy6",	spinbench },
+	{ "sy7",	lockconvoy },
+	{ "wq",		wqtest },
+	{ "rt",		rttest },
 #ifdef UW
 	{ "uw1",	uwlocktest1 },
 	{ "uw2",	uwvmstatstest },
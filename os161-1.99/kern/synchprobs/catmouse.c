@@ -77,10 +77,10 @@ static int MouseSleepTime = 2;  // length of time a mouse spends sleeping
 
 /*
  * Once the main driver function (catmouse()) has created the cat and mouse
- * simulation threads, it uses this semaphore to block until all of the
+ * simulation threads, it uses this latch to block until all of the
  * cat and mouse simulations are finished.
  */
-static struct semaphore *CatMouseWait;
+static struct latch *CatMouseWait;
 
 /*
  *
@@ -553,7 +553,7 @@ cat_simulation(void * unusedpointer,
   }
 
   /* indicate that this cat simulation is finished */
-  V(CatMouseWait); 
+  latch_countdown(CatMouseWait);
 }
 
 /*
@@ -616,7 +616,7 @@ mouse_simulation(void * unusedpointer,
   }
 
   /* indicate that this mouse is finished */
-  V(CatMouseWait); 
+  latch_countdown(CatMouseWait);
 }
 
 /*
@@ -647,7 +647,6 @@ catmouse(int nargs,
          char ** args)
 {
   int catindex, mouseindex, error;
-  int i;
   int mean_cat_wait_usecs, mean_mouse_wait_usecs;
   time_t before_sec, after_sec, wait_sec;
   uint32_t before_nsec, after_nsec, wait_nsec;
@@ -719,11 +718,11 @@ catmouse(int nargs,
   kprintf("Using cat eating time %d, cat sleeping time %d\n", CatEatTime, CatSleepTime);
   kprintf("Using mouse eating time %d, mouse sleeping time %d\n", MouseEatTime, MouseSleepTime);
 
-  /* create the semaphore that is used to make the main thread
+  /* create the latch that is used to make the main thread
      wait for all of the cats and mice to finish */
-  CatMouseWait = sem_create("CatMouseWait",0);
+  CatMouseWait = latch_create("CatMouseWait",NumCats+NumMice);
   if (CatMouseWait == NULL) {
-    panic("catmouse: could not create semaphore\n");
+    panic("catmouse: could not create latch\n");
   }
 
   /* initialize our simulation state */
@@ -761,9 +760,7 @@ catmouse(int nargs,
   
   /* wait for all of the cats and mice to finish before
      terminating */  
-  for(i=0;i<(NumCats+NumMice);i++) {
-    P(CatMouseWait);
-  }
+  latch_wait(CatMouseWait);
 
   /* get current time, for measuring total simulation time */
   gettime(&after_sec,&after_nsec);
@@ -777,8 +774,8 @@ catmouse(int nargs,
     kprintf("STATS: Bowl utilization: %d%%\n",utilization_percent);
   }
 
-  /* clean up the semaphore that we created */
-  sem_destroy(CatMouseWait);
+  /* clean up the latch that we created */
+  latch_destroy(CatMouseWait);
 
   /* clean up the synchronization state */
   catmouse_sync_cleanup(NumBowls);
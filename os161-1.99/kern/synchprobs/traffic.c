@@ -52,10 +52,10 @@ static int DirectionBias = 0;  // 0 = unbiased, 1 = biased
 
 /*
  * Once the main driver function has created the 
- * simulation threads, it uses this semaphore to block until all of the
+ * simulation threads, it uses this latch to block until all of the
  * simulation threads are finished.
  */
-static struct semaphore *SimulationWait;
+static struct latch *SimulationWait;
 
 /*
  *
@@ -349,9 +349,9 @@ initialize_state(void)
   if (perf_mutex == NULL) {
     panic("could not create perf_mutex semaphore\n");
   }
-  SimulationWait = sem_create("SimulationWait",0);
+  SimulationWait = latch_create("SimulationWait",NumThreads);
   if (SimulationWait == NULL) {
-    panic("could not create SimulationWait semaphore\n");
+    panic("could not create SimulationWait latch\n");
   }
   heavy_direction = random()%4;
   /* initialization for synchronization code */
@@ -378,7 +378,7 @@ cleanup_state(void)
 {
   sem_destroy(mutex);
   sem_destroy(perf_mutex);
-  sem_destroy(SimulationWait);
+  latch_destroy(SimulationWait);
   intersection_sync_cleanup();
 }
 
@@ -514,7 +514,7 @@ vehicle_simulation(void * unusedpointer,
   }
 
   /* indicate that this simulation is finished */
-  V(SimulationWait); 
+  latch_countdown(SimulationWait);
 }
 
 
@@ -594,9 +594,7 @@ traffic_simulation(int nargs,
   }
   
   /* wait for all of the vehicle simulations to finish before terminating */  
-  for(i=0;i<NumThreads;i++) {
-    P(SimulationWait);
-  }
+  latch_wait(SimulationWait);
 
   /* get simulation end time */
   gettime(&end_sec,&end_nsec);
@@ -9,6 +9,344 @@
 #include <current.h>
 #include <proc.h>
 
+#include "opt-A2.h"
+#if OPT_A2
+  #include <kern/fcntl.h>
+  #include <kern/seek.h>
+  #include <limits.h>
+  #include <stat.h>
+  #include <synch.h>
+  #include <atomic.h>
+  #include <copyinout.h>
+  #include <file.h>
+#endif
+
+#if OPT_A2
+  /*
+   * Open files; see <file.h>.
+   */
+  int openfile_open(char *path, int flags, mode_t mode, struct openfile **ret) {
+    struct openfile *of;
+    int result;
+
+    of = kmalloc(sizeof(*of));
+    if (of == NULL) {
+      return ENOMEM;
+    }
+    of->of_lock = lock_create("openfile");
+    if (of->of_lock == NULL) {
+      kfree(of);
+      return ENOMEM;
+    }
+    result = vfs_open(path, flags, mode, &of->of_vnode);
+    if (result) {
+      lock_destroy(of->of_lock);
+      kfree(of);
+      return result;
+    }
+    of->of_accmode = flags & O_ACCMODE;
+    of->of_append = (flags & O_APPEND) != 0;
+    of->of_offset = 0;
+    of->of_refcount = 1;
+    *ret = of;
+    return 0;
+  }
+
+  void openfile_incref(struct openfile *of) {
+    atomic_inc(&of->of_refcount);
+  }
+
+  void openfile_decref(struct openfile *of) {
+    if (atomic_dec(&of->of_refcount) > 0) {
+      return;
+    }
+    vfs_close(of->of_vnode);
+    lock_destroy(of->of_lock);
+    kfree(of);
+  }
+
+  /*
+   * Descriptor tables. Slots are looked up by index, so finding a
+   * descriptor is constant time; only fd_add searches, for the
+   * lowest free slot.
+   */
+  int fd_get(struct proc *p, int fd, struct openfile **ret) {
+    struct openfile *of;
+
+    if (fd < 0 || fd >= OPEN_MAX) {
+      return EBADF;
+    }
+    spinlock_acquire(&p->p_lock);
+    of = p->p_fds[fd];
+    if (of != NULL) {
+      openfile_incref(of);
+    }
+    spinlock_release(&p->p_lock);
+    if (of == NULL) {
+      return EBADF;
+    }
+    *ret = of;
+    return 0;
+  }
+
+  int fd_add(struct proc *p, struct openfile *of, int *fd) {
+    int i;
+
+    spinlock_acquire(&p->p_lock);
+    for (i = 0; i < OPEN_MAX; i++) {
+      if (p->p_fds[i] == NULL) {
+        p->p_fds[i] = of;
+        spinlock_release(&p->p_lock);
+        *fd = i;
+        return 0;
+      }
+    }
+    spinlock_release(&p->p_lock);
+    return EMFILE;
+  }
+
+  int fdtable_console(struct proc *p) {
+    static const int modes[3] = { O_RDONLY, O_WRONLY, O_WRONLY };
+    char path[5];
+    struct openfile *of;
+    int i, fd, result;
+
+    for (i = 0; i < 3; i++) {
+      /* vfs_open may scribble on the name */
+      strcpy(path, "con:");
+      result = openfile_open(path, modes[i], 0, &of);
+      if (result) {
+        fdtable_closeall(p);
+        return result;
+      }
+      result = fd_add(p, of, &fd);
+      KASSERT(result == 0 && fd == i);
+    }
+    return 0;
+  }
+
+  void fdtable_copy(struct proc *src, struct proc *dst) {
+    int i;
+
+    spinlock_acquire(&src->p_lock);
+    for (i = 0; i < OPEN_MAX; i++) {
+      KASSERT(dst->p_fds[i] == NULL);
+      dst->p_fds[i] = src->p_fds[i];
+      if (dst->p_fds[i] != NULL) {
+        openfile_incref(dst->p_fds[i]);
+      }
+    }
+    spinlock_release(&src->p_lock);
+  }
+
+  void fdtable_closeall(struct proc *p) {
+    struct openfile *of;
+    int i;
+
+    for (i = 0; i < OPEN_MAX; i++) {
+      spinlock_acquire(&p->p_lock);
+      of = p->p_fds[i];
+      p->p_fds[i] = NULL;
+      spinlock_release(&p->p_lock);
+      if (of != NULL) {
+        openfile_decref(of);
+      }
+    }
+  }
+
+  /*
+   * Set up a uio for NBYTES of user buffer UBUF at the openfile's
+   * position. For O_APPEND writes, that's the end of the file.
+   * Call with of_lock held.
+   */
+  static int file_uio(struct openfile *of, struct iovec *iov, struct uio *u,
+                      userptr_t ubuf, size_t nbytes, enum uio_rw rw) {
+    struct stat st;
+    int result;
+
+    if (rw == UIO_WRITE && of->of_append) {
+      result = VOP_STAT(of->of_vnode, &st);
+      if (result) {
+        return result;
+      }
+      of->of_offset = st.st_size;
+    }
+    iov->iov_ubase = ubuf;
+    iov->iov_len = nbytes;
+    u->uio_iov = iov;
+    u->uio_iovcnt = 1;
+    u->uio_offset = of->of_offset;
+    u->uio_resid = nbytes;
+    u->uio_segflg = UIO_USERSPACE;
+    u->uio_rw = rw;
+    u->uio_space = curproc_getas();
+    return 0;
+  }
+
+  /* Common part of read() and write(). */
+  static int file_rw(int fdesc, userptr_t ubuf, size_t nbytes,
+                     enum uio_rw rw, int *retval) {
+    struct openfile *of;
+    struct iovec iov;
+    struct uio u;
+    int result;
+
+    result = fd_get(curproc, fdesc, &of);
+    if (result) {
+      return result;
+    }
+    if (of->of_accmode == (rw == UIO_READ ? O_WRONLY : O_RDONLY)) {
+      openfile_decref(of);
+      return EBADF;
+    }
+
+    lock_acquire(of->of_lock);
+    result = file_uio(of, &iov, &u, ubuf, nbytes, rw);
+    if (result == 0) {
+      if (rw == UIO_READ) {
+        result = VOP_READ(of->of_vnode, &u);
+      } else {
+        result = VOP_WRITE(of->of_vnode, &u);
+      }
+    }
+    if (result == 0) {
+      of->of_offset = u.uio_offset;
+    }
+    lock_release(of->of_lock);
+    openfile_decref(of);
+    if (result) {
+      return result;
+    }
+
+    /* pass back the number of bytes actually transferred */
+    *retval = nbytes - u.uio_resid;
+    KASSERT(*retval >= 0);
+    return 0;
+  }
+
+  int sys_open(userptr_t upath, int flags, mode_t mode, int *retval) {
+    struct openfile *of;
+    char *path;
+    int result;
+
+    path = kmalloc(PATH_MAX);
+    if (path == NULL) {
+      return ENOMEM;
+    }
+    result = copyinstr(upath, path, PATH_MAX, NULL);
+    if (result == 0) {
+      result = openfile_open(path, flags, mode, &of);
+    }
+    kfree(path);
+    if (result) {
+      return result;
+    }
+    result = fd_add(curproc, of, retval);
+    if (result) {
+      openfile_decref(of);
+    }
+    return result;
+  }
+
+  int sys_read(int fdesc, userptr_t ubuf, unsigned int nbytes, int *retval) {
+    DEBUG(DB_SYSCALL,"Syscall: read(%d,%x,%d)\n",fdesc,(unsigned int)ubuf,nbytes);
+    return file_rw(fdesc, ubuf, nbytes, UIO_READ, retval);
+  }
+
+  int sys_write(int fdesc, userptr_t ubuf, unsigned int nbytes, int *retval) {
+    DEBUG(DB_SYSCALL,"Syscall: write(%d,%x,%d)\n",fdesc,(unsigned int)ubuf,nbytes);
+    return file_rw(fdesc, ubuf, nbytes, UIO_WRITE, retval);
+  }
+
+  int sys_lseek(int fdesc, off_t pos, int whence, off_t *retval) {
+    struct openfile *of;
+    struct stat st;
+    off_t newpos;
+    int result;
+
+    result = fd_get(curproc, fdesc, &of);
+    if (result) {
+      return result;
+    }
+
+    newpos = 0;
+    lock_acquire(of->of_lock);
+    switch (whence) {
+    case SEEK_SET:
+      newpos = pos;
+      break;
+    case SEEK_CUR:
+      newpos = of->of_offset + pos;
+      break;
+    case SEEK_END:
+      result = VOP_STAT(of->of_vnode, &st);
+      if (result == 0) {
+        newpos = st.st_size + pos;
+      }
+      break;
+    default:
+      result = EINVAL;
+      break;
+    }
+    if (result == 0 && newpos < 0) {
+      result = EINVAL;
+    }
+    if (result == 0) {
+      /* fails with ESPIPE on the console and other devices */
+      result = VOP_TRYSEEK(of->of_vnode, newpos);
+    }
+    if (result == 0) {
+      of->of_offset = newpos;
+      *retval = newpos;
+    }
+    lock_release(of->of_lock);
+    openfile_decref(of);
+    return result;
+  }
+
+  int sys_close(int fdesc) {
+    struct proc *p = curproc;
+    struct openfile *of;
+
+    if (fdesc < 0 || fdesc >= OPEN_MAX) {
+      return EBADF;
+    }
+    spinlock_acquire(&p->p_lock);
+    of = p->p_fds[fdesc];
+    p->p_fds[fdesc] = NULL;
+    spinlock_release(&p->p_lock);
+    if (of == NULL) {
+      return EBADF;
+    }
+    openfile_decref(of);
+    return 0;
+  }
+
+  int sys_dup2(int oldfd, int newfd, int *retval) {
+    struct proc *p = curproc;
+    struct openfile *of, *prev;
+    int result;
+
+    if (newfd < 0 || newfd >= OPEN_MAX) {
+      return EBADF;
+    }
+    result = fd_get(p, oldfd, &of);
+    if (result) {
+      return result;
+    }
+    /* our reference becomes newfd's */
+    spinlock_acquire(&p->p_lock);
+    prev = p->p_fds[newfd];
+    p->p_fds[newfd] = of;
+    spinlock_release(&p->p_lock);
+    if (prev != NULL) {
+      openfile_decref(prev);
+    }
+    *retval = newfd;
+    return 0;
+  }
+
+#else
 /* handler for write() system call                  */
 /*
  * n.b.
@@ -58,3 +396,4 @@ sys_write(int fdesc,userptr_t ubuf,unsigned int nbytes,int *retval)
   KASSERT(*retval >= 0);
   return 0;
 }
+#endif
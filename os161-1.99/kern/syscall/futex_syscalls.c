@@ -0,0 +1,322 @@
+/*
+ * Copyright (c) 2000, 2001
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/*
+ * Futex system calls. See futex.h.
+ */
+
+#include <types.h>
+#include <kern/errno.h>
+#include <lib.h>
+#include <spinlock.h>
+#include <wchan.h>
+#include <vm.h>
+#include <current.h>
+#include <proc.h>
+#include <futex.h>
+#include <syscall.h>
+
+#include "opt-A2.h"
+
+#define FUTEX_HASHSIZE  64	/* must be a power of 2 */
+
+/*
+ * One of these exists for each address that has threads in
+ * futex_wait. f_sleepers counts the ones that haven't been woken
+ * yet; f_refs also counts the ones that have been woken but haven't
+ * got out of futex_wait, and the last of those frees it.
+ *
+ * Processes don't share memory, so every waiter on a given key is
+ * in the same process, f_proc.
+ */
+struct futex {
+	paddr_t f_key;
+	struct proc *f_proc;
+	struct wchan *f_wchan;
+	unsigned f_sleepers;
+	unsigned f_refs;
+	struct futex *f_next;
+};
+
+struct futex_bucket {
+	struct spinlock fb_lock;
+	struct futex *fb_head;
+};
+
+static struct futex_bucket futex_table[FUTEX_HASHSIZE];
+
+void
+futex_bootstrap(void)
+{
+	unsigned i;
+
+	for (i=0; i<FUTEX_HASHSIZE; i++) {
+		spinlock_init(&futex_table[i].fb_lock);
+		futex_table[i].fb_head = NULL;
+	}
+}
+
+static
+struct futex_bucket *
+futex_hash(paddr_t key)
+{
+	unsigned h;
+
+	/* words within a page, and pages themselves, both spread out */
+	h = (key >> 2) ^ (key >> 12);
+	return &futex_table[h & (FUTEX_HASHSIZE - 1)];
+}
+
+/*
+ * Translate a user address to a futex key.
+ */
+static
+int
+futex_key(userptr_t uaddr, paddr_t *key)
+{
+	vaddr_t vaddr = (vaddr_t)uaddr;
+
+	if (vaddr % sizeof(uint32_t) != 0) {
+		return EINVAL;
+	}
+	return vm_translate(vaddr, key);
+}
+
+static
+struct futex *
+futex_create(paddr_t key)
+{
+	struct futex *f;
+
+	f = kmalloc(sizeof(struct futex));
+	if (f == NULL) {
+		return NULL;
+	}
+	f->f_wchan = wchan_create("futex");
+	if (f->f_wchan == NULL) {
+		kfree(f);
+		return NULL;
+	}
+	f->f_key = key;
+	f->f_proc = curproc;
+	f->f_sleepers = 0;
+	f->f_refs = 0;
+	f->f_next = NULL;
+	return f;
+}
+
+static
+void
+futex_destroy(struct futex *f)
+{
+	KASSERT(f->f_refs == 0);
+	wchan_destroy(f->f_wchan);
+	kfree(f);
+}
+
+/*
+ * Find the futex for KEY. Call with the bucket locked.
+ */
+static
+struct futex *
+futex_find(struct futex_bucket *fb, paddr_t key)
+{
+	struct futex *f;
+
+	for (f = fb->fb_head; f != NULL; f = f->f_next) {
+		if (f->f_key == key) {
+			return f;
+		}
+	}
+	return NULL;
+}
+
+static
+void
+futex_unlink(struct futex_bucket *fb, struct futex *f)
+{
+	struct futex **fp;
+
+	for (fp = &fb->fb_head; *fp != f; fp = &(*fp)->f_next) {
+		KASSERT(*fp != NULL);
+	}
+	*fp = f->f_next;
+}
+
+int
+sys_futex_wait(userptr_t uaddr, uint32_t val)
+{
+	struct futex_bucket *fb;
+	struct futex *f, *newf = NULL;
+	volatile uint32_t *word;
+	paddr_t key;
+	int result;
+
+	result = futex_key(uaddr, &key);
+	if (result) {
+		return result;
+	}
+
+	/*
+	 * dumbvm never moves or unmaps a user page while the address
+	 * space exists, so we can read the word through its physical
+	 * address. Unlike copyin, that can't fault, so it's safe with
+	 * the bucket locked, and holding the bucket lock from the check
+	 * until we're on the wchan is what keeps futex_wake from
+	 * slipping in between.
+	 */
+	word = (volatile uint32_t *)PADDR_TO_KVADDR(key);
+	fb = futex_hash(key);
+
+	spinlock_acquire(&fb->fb_lock);
+	while (1) {
+#if OPT_A2
+		/*
+		 * Checked under the bucket lock, so either we see it here
+		 * or futex_wakeproc sees us asleep.
+		 */
+		if (curproc->p_exiting) {
+			spinlock_release(&fb->fb_lock);
+			if (newf != NULL) {
+				futex_destroy(newf);
+			}
+			return EINTR;
+		}
+#endif
+		if (*word != val) {
+			spinlock_release(&fb->fb_lock);
+			if (newf != NULL) {
+				futex_destroy(newf);
+			}
+			return EAGAIN;
+		}
+		f = futex_find(fb, key);
+		if (f != NULL) {
+			break;
+		}
+		if (newf != NULL) {
+			f = newf;
+			newf = NULL;
+			f->f_next = fb->fb_head;
+			fb->fb_head = f;
+			break;
+		}
+		/* First waiter here; allocate without the lock and retry. */
+		spinlock_release(&fb->fb_lock);
+		newf = futex_create(key);
+		if (newf == NULL) {
+			return ENOMEM;
+		}
+		spinlock_acquire(&fb->fb_lock);
+	}
+
+	f->f_refs++;
+	f->f_sleepers++;
+	wchan_lock(f->f_wchan);
+	spinlock_release(&fb->fb_lock);
+	wchan_sleep(f->f_wchan);
+
+	spinlock_acquire(&fb->fb_lock);
+	KASSERT(f->f_refs > 0);
+	f->f_refs--;
+	if (f->f_refs == 0) {
+		futex_unlink(fb, f);
+	}
+	else {
+		f = NULL;
+	}
+	spinlock_release(&fb->fb_lock);
+
+	if (f != NULL) {
+		futex_destroy(f);
+	}
+	if (newf != NULL) {
+		/* someone else created it while we were allocating */
+		futex_destroy(newf);
+	}
+	return 0;
+}
+
+int
+sys_futex_wake(userptr_t uaddr, int n, int *retval)
+{
+	struct futex_bucket *fb;
+	struct futex *f;
+	paddr_t key;
+	int result, woken;
+
+	if (n < 0) {
+		return EINVAL;
+	}
+	result = futex_key(uaddr, &key);
+	if (result) {
+		return result;
+	}
+	fb = futex_hash(key);
+
+	woken = 0;
+	spinlock_acquire(&fb->fb_lock);
+	f = futex_find(fb, key);
+	if (f != NULL) {
+		while (woken < n && f->f_sleepers > 0) {
+			wchan_wakeone(f->f_wchan);
+			f->f_sleepers--;
+			woken++;
+		}
+	}
+	spinlock_release(&fb->fb_lock);
+
+	*retval = woken;
+	return 0;
+}
+
+/*
+ * Wake every thread of process P that's asleep in futex_wait, so that
+ * it notices the process is exiting. To them it looks like an ordinary
+ * (if unexpected) wakeup.
+ */
+void
+futex_wakeproc(struct proc *p)
+{
+	struct futex_bucket *fb;
+	struct futex *f;
+	unsigned i;
+
+	for (i=0; i<FUTEX_HASHSIZE; i++) {
+		fb = &futex_table[i];
+		spinlock_acquire(&fb->fb_lock);
+		for (f = fb->fb_head; f != NULL; f = f->f_next) {
+			if (f->f_proc == p && f->f_sleepers > 0) {
+				wchan_wakeall(f->f_wchan);
+				f->f_sleepers = 0;
+			}
+		}
+		spinlock_release(&fb->fb_lock);
+	}
+}
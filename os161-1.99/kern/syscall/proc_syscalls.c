@@ -14,80 +14,190 @@
 #if OPT_A2
   // ASST2a
   #include <mips/trapframe.h>
+  #include <limits.h>
 #endif
 #if OPT_A2
   // ASST2b
   #include <vfs.h>
   #include <kern/fcntl.h>
 #endif
+#if OPT_A2
+  #include <vm.h>
+  #include <futex.h>
+  #include <file.h>
+#endif
 
-  /* this implementation of sys__exit does not do anything with the exit code */
-  /* this needs to be fixed to get exit() and waitpid() working properly */
-
-void sys__exit(int exitcode) {
-
-  struct addrspace *as;
-  struct proc *p = curproc;
+#if OPT_A2
+  /*
+   * Family lists; see struct proc. Call with proc_familylock held.
+   */
+  static void child_link(struct proc **head, struct proc *child) {
+    child->p_sibprev = NULL;
+    child->p_sibnext = *head;
+    if (*head != NULL) {
+      (*head)->p_sibprev = child;
+    }
+    *head = child;
+  }
 
-  DEBUG(DB_SYSCALL,"Syscall: _exit(%d)\n",exitcode);
+  static void child_unlink(struct proc **head, struct proc *child) {
+    if (child->p_sibprev != NULL) {
+      child->p_sibprev->p_sibnext = child->p_sibnext;
+    } else {
+      KASSERT(*head == child);
+      *head = child->p_sibnext;
+    }
+    if (child->p_sibnext != NULL) {
+      child->p_sibnext->p_sibprev = child->p_sibprev;
+    }
+    child->p_sibprev = child->p_sibnext = NULL;
+  }
 
-  KASSERT(curproc->p_addrspace != NULL);
-  as_deactivate();
   /*
-   * clear p_addrspace before calling as_destroy. Otherwise if
-   * as_destroy sleeps (which is quite possible) when we
-   * come back we'll be calling as_activate on a
-   * half-destroyed address space. This tends to be
-   * messily fatal.
+   * Take the current thread out of its process for good. The last
+   * thread out tears the process down: its address space, its
+   * children, and then either the proc itself or, if the parent may
+   * still wait for it, just the exit status.
    */
-  as = curproc_setas(NULL);
-  as_destroy(as);
+  static void proc_leave(void) {
+    struct proc *p = curproc;
+    struct addrspace *as;
+    int exitcode;
 
-  #if OPT_A2
-    // ASST2a
-    while (array_num(p->p_children) >= 1) {
-      struct proc *temp_child_proc = array_get(p->p_children, 0);
-      array_remove(p->p_children, 0);
-      spinlock_acquire(&temp_child_proc->p_lock);
-      if (temp_child_proc->p_exitstatus != 0) {
-        spinlock_release(&temp_child_proc->p_lock);
-        proc_destroy(temp_child_proc);
-      } else {
-        temp_child_proc->p_parent = NULL;
-        spinlock_release(&temp_child_proc->p_lock);
-      }
-    }
-  #else
-    /* for now, just include this to keep the compiler from complaining about
-       an unused variable */
-    (void)exitcode;
-  #endif
+    as_deactivate();
 
-  /* detach this thread from its process */
-  /* note: curproc cannot be used after this call */
-  proc_remthread(curthread);
+    /* detach this thread from its process */
+    /* note: curproc cannot be used after this call */
+    if (proc_remthread(curthread) > 0) {
+      /* not the last one out */
+      thread_exit();
+    }
 
-  #if OPT_A2
-    // ASST2a
+    /*
+     * clear p_addrspace before calling as_destroy. Otherwise if
+     * as_destroy sleeps (which is quite possible) we'd have an
+     * address space that's half-destroyed but still reachable.
+     */
     spinlock_acquire(&p->p_lock);
+    as = p->p_addrspace;
+    p->p_addrspace = NULL;
+    exitcode = p->p_exitpending;
+    spinlock_release(&p->p_lock);
+    as_destroy(as);
+
+    /* the files can be closed now; no need to wait for the parent */
+    fdtable_closeall(p);
+
+    lock_acquire(proc_familylock);
+
+    /* running children are orphaned; they clean up after themselves */
+    while (p->p_livechildren != NULL) {
+      struct proc *child = p->p_livechildren;
+      child_unlink(&p->p_livechildren, child);
+      child->p_parent = NULL;
+    }
+    /* nobody will wait for the exited ones now */
+    while (p->p_deadchildren != NULL) {
+      struct proc *child = p->p_deadchildren;
+      child_unlink(&p->p_deadchildren, child);
+      proc_destroy(child);
+    }
+
     if (p->p_parent == NULL) {
-      spinlock_release(&p->p_lock);
+      lock_release(proc_familylock);
       proc_destroy(p);
     } else {
       p->p_exitstatus = 1;
       p->p_exitcode = _MKWAIT_EXIT(exitcode);
-      spinlock_release(&p->p_lock);
+      child_unlink(&p->p_parent->p_livechildren, p);
+      child_link(&p->p_parent->p_deadchildren, p);
+      cv_broadcast(p->p_parent->p_childcv, proc_familylock);
+      lock_release(proc_familylock);
+    }
+
+    thread_exit();
+  }
+
+  /*
+   * Called by every user thread on its way back to user mode. If some
+   * thread has called _exit, leave instead.
+   */
+  void proc_exitcheck(void) {
+    struct proc *p = curproc;
+
+    if (p == NULL || !p->p_exiting) {
+      return;
+    }
+    /* our record, if any, goes away with the process */
+    curthread->t_uthread = NULL;
+    proc_leave();
+  }
+#endif
+
+void sys__exit(int exitcode) {
+
+  DEBUG(DB_SYSCALL,"Syscall: _exit(%d)\n",exitcode);
+
+  #if OPT_A2
+    struct proc *p = curproc;
+    bool others;
+
+    /*
+     * _exit ends the whole process, not just this thread. The first
+     * caller's code wins. Other threads leave when they next head
+     * for user mode; wake up any that are asleep in thread_join,
+     * waitpid, futex_wait or a console read so that they do. See
+     * proc.h for the sleeps this does not reach.
+     */
+    spinlock_acquire(&p->p_lock);
+    if (!p->p_exiting) {
+      p->p_exiting = true;
+      p->p_exitpending = exitcode;
+    }
+    others = threadarray_num(&p->p_threads) > 1;
+    spinlock_release(&p->p_lock);
+
+    if (others) {
       lock_acquire(p->p_lck);
-      cv_broadcast(p->p_cv, p->p_lck);
+      cv_broadcast(p->p_threadcv, p->p_lck);
       lock_release(p->p_lck);
+      lock_acquire(proc_familylock);
+      cv_broadcast(p->p_childcv, proc_familylock);
+      lock_release(proc_familylock);
+      futex_wakeproc(p);
+      getch_interrupt();
     }
+
+    proc_leave();
   #else
+    struct addrspace *as;
+    struct proc *p = curproc;
+    /* for now, just include this to keep the compiler from complaining about
+       an unused variable */
+    (void)exitcode;
+
+    KASSERT(curproc->p_addrspace != NULL);
+    as_deactivate();
+    /*
+     * clear p_addrspace before calling as_destroy. Otherwise if
+     * as_destroy sleeps (which is quite possible) when we
+     * come back we'll be calling as_activate on a
+     * half-destroyed address space. This tends to be
+     * messily fatal.
+     */
+    as = curproc_setas(NULL);
+    as_destroy(as);
+
+    /* detach this thread from its process */
+    /* note: curproc cannot be used after this call */
+    proc_remthread(curthread);
+
     /* if this is the last user process in the system, proc_destroy()
        will wake up the kernel menu thread */
     proc_destroy(p);
-  #endif
   
-  thread_exit();
+    thread_exit();
+  #endif
   /* thread_exit() does not return, so we should never get here */
   panic("return from thread_exit in sys_exit\n");
 }
@@ -121,36 +231,70 @@ int sys_waitpid(pid_t pid, userptr_t status, int options, pid_t *retval) {
      Fix this!
   */
 
-  if (options != 0) {
-    return(EINVAL);
-  }
-
   #if OPT_A2
     // ASST2a
-    struct proc *temp_child = NULL;
-    int len = array_num(curproc->p_children);
-    for (int i = 0; i < len; ++i) {
-      temp_child = array_get(curproc->p_children, i);
-      if (temp_child->p_pid == pid) {
-        array_remove(curproc->p_children, i);
-        break;
-      }
-      temp_child = NULL;
+    /*
+     * PID -1 means any child. Exited children are kept on their own
+     * list, so that's its head; a particular child is found through
+     * the PID table. Either way, no scanning. WNOHANG returns 0
+     * instead of sleeping if the child(ren) haven't exited yet.
+     */
+    struct proc *p = curproc;
+    struct proc *child;
+
+    if ((options & ~WNOHANG) != 0) {
+      return EINVAL;
     }
-    if (temp_child == NULL) {
-      panic("waitpid child not found\n");
-      return (ECHILD);
+    if (pid != -1 && pid < PID_MIN) {
+      /* no process groups */
+      return EINVAL;
     }
 
-    lock_acquire(temp_child->p_lck);
-    while (temp_child->p_exitstatus == 0) {
-      cv_wait(temp_child->p_cv, temp_child->p_lck);
+    lock_acquire(proc_familylock);
+    while (1) {
+      if (pid == -1) {
+        child = p->p_deadchildren;
+        if (child == NULL && p->p_livechildren == NULL) {
+          lock_release(proc_familylock);
+          return ECHILD;
+        }
+      } else {
+        child = proc_lookup(pid);
+        if (child == NULL || child->p_parent != p) {
+          lock_release(proc_familylock);
+          return ECHILD;
+        }
+        if (child->p_exitstatus == 0) {
+          child = NULL;
+        }
+      }
+      if (child != NULL) {
+        break;
+      }
+      if (options & WNOHANG) {
+        lock_release(proc_familylock);
+        *retval = 0;
+        return 0;
+      }
+      if (p->p_exiting) {
+        /* another thread called _exit; go and leave */
+        lock_release(proc_familylock);
+        return EINTR;
+      }
+      cv_wait(p->p_childcv, proc_familylock);
     }
-    exitstatus = temp_child->p_exitcode;
-    lock_release(temp_child->p_lck);
-    proc_destroy(temp_child);
+
+    child_unlink(&p->p_deadchildren, child);
+    child->p_parent = NULL;
+    exitstatus = child->p_exitcode;
+    pid = child->p_pid;
+    lock_release(proc_familylock);
+    proc_destroy(child);
 
   #else
+  if (options != 0) {
+    return(EINVAL);
+  }
     /* for now, just pretend the exitstatus is 0 */
     exitstatus = 0;
     
@@ -169,17 +313,15 @@ int sys_waitpid(pid_t pid, userptr_t status, int options, pid_t *retval) {
   // ASST2a
   int sys_fork(pid_t *retval, struct trapframe *tf) {
     struct proc *child_proc = proc_create_runprogram("child proc");
-    KASSERT(child_proc != NULL);
-    child_proc->p_parent = curproc;
-    array_init(child_proc->p_children);
-    spinlock_acquire(&curproc->p_lock);
-    int err = array_add(curproc->p_children, child_proc, NULL);
-    spinlock_release(&curproc->p_lock);
-    if (err != 0) {
-      panic("array add child process unsuccessful\n");
+    if (child_proc == NULL) {
+      return ENPROC;
     }
+    lock_acquire(proc_familylock);
+    child_proc->p_parent = curproc;
+    child_link(&curproc->p_livechildren, child_proc);
+    lock_release(proc_familylock);
     struct addrspace *new_addr;
-    err = as_copy(curproc_getas(), &new_addr);
+    int err = as_copy(curproc_getas(), &new_addr);
     if (err != 0) {
       panic("addr copy to child process unsuccessful\n");
     }
@@ -207,6 +349,15 @@ int sys_waitpid(pid_t pid, userptr_t status, int options, pid_t *retval) {
     struct vnode *v;
     vaddr_t entrypoint, stackptr;
     int result;
+    unsigned nthreads;
+
+    // Other threads would be left running in the old address space
+    spinlock_acquire(&curproc->p_lock);
+    nthreads = threadarray_num(&curproc->p_threads);
+    spinlock_release(&curproc->p_lock);
+    if (nthreads > 1) {
+      return EBUSY;
+    }
 
     // Find arg count
     char **argp = argv; // can't iterate through argv or we lose start
@@ -308,3 +459,162 @@ int sys_waitpid(pid_t pid, userptr_t status, int options, pid_t *retval) {
   }
 #endif
 
+
+#if OPT_A2
+  /* What a new user thread needs to get going; freed once it has. */
+  struct uthread_start {
+    vaddr_t us_entry;
+    vaddr_t us_arg;
+    vaddr_t us_stack;
+    struct uthread *us_ut;
+  };
+
+  static void uthread_start(void *data, unsigned long unused) {
+    struct uthread_start us = *(struct uthread_start *)data;
+
+    (void)unused;
+    kfree(data);
+    curthread->t_uthread = us.us_ut;
+    /* the process may have started exiting before we ran */
+    proc_exitcheck();
+    enter_user_thread(us.us_entry, us.us_arg, us.us_stack);
+  }
+
+  /*
+   * Start a new thread in the current process running func(arg), and
+   * return its thread id. It shares the address space. The caller
+   * supplies the stack (dumbvm can't add regions to an address space),
+   * passing the address of its top; it must be mapped. The thread
+   * starts with sp 16 bytes below that (rounded down to 8), leaving
+   * the o32 argument area that func may spill a0-a3 into, since no
+   * crt0-style stub runs first. func must not return: ra is 0, so
+   * it has to end with thread_exit.
+   */
+  int sys_thread_create(userptr_t func, userptr_t arg, userptr_t stack,
+                        int *retval) {
+    struct proc *p = curproc;
+    struct uthread_start *us;
+    struct uthread *ut, **utp;
+    vaddr_t sp;
+    paddr_t junk;
+    int tid, result;
+
+    // stack must be 8-byte aligned, with room for the argument area
+    sp = (vaddr_t)stack & ~(vaddr_t)7;
+    if (sp < 16) {
+      return EFAULT;
+    }
+    sp -= 16;
+    if (vm_translate((vaddr_t)func, &junk) != 0 ||
+        vm_translate(sp, &junk) != 0 ||
+        vm_translate(sp + 15, &junk) != 0) {
+      return EFAULT;
+    }
+
+    ut = kmalloc(sizeof(struct uthread));
+    if (ut == NULL) {
+      return ENOMEM;
+    }
+    us = kmalloc(sizeof(struct uthread_start));
+    if (us == NULL) {
+      kfree(ut);
+      return ENOMEM;
+    }
+    ut->ut_exited = false;
+    ut->ut_joining = false;
+    ut->ut_retval = 0;
+    us->us_entry = (vaddr_t)func;
+    us->us_arg = (vaddr_t)arg;
+    us->us_stack = sp;
+    us->us_ut = ut;
+
+    lock_acquire(p->p_lck);
+    tid = ut->ut_tid = p->p_nexttid++;
+    ut->ut_next = p->p_uthreads;
+    p->p_uthreads = ut;
+    lock_release(p->p_lck);
+
+    result = thread_fork(p->p_name, p, uthread_start, us, 0);
+    if (result) {
+      lock_acquire(p->p_lck);
+      for (utp = &p->p_uthreads; *utp != ut; utp = &(*utp)->ut_next);
+      *utp = ut->ut_next;
+      lock_release(p->p_lck);
+      kfree(ut);
+      kfree(us);
+      return result;
+    }
+
+    /* ut may already be gone, if the thread was quick and got joined */
+    *retval = tid;
+    return 0;
+  }
+
+  /*
+   * End the current thread. If it's the last one, this ends the
+   * process too, with exit code 0.
+   */
+  void sys_thread_exit(int retval) {
+    struct proc *p = curproc;
+    struct uthread *ut = curthread->t_uthread;
+
+    if (ut != NULL) {
+      lock_acquire(p->p_lck);
+      ut->ut_exited = true;
+      ut->ut_retval = retval;
+      cv_broadcast(p->p_threadcv, p->p_lck);
+      lock_release(p->p_lck);
+      /* a joiner may free ut from here on */
+      curthread->t_uthread = NULL;
+    }
+    proc_leave();
+  }
+
+  /*
+   * Wait for thread tid to exit and collect its thread_exit value.
+   * Each thread can be joined once; the first thread (tid 0) can't be
+   * joined at all.
+   */
+  int sys_thread_join(int tid, userptr_t retvalp) {
+    struct proc *p = curproc;
+    struct uthread *ut, **utp;
+    int rv;
+
+    lock_acquire(p->p_lck);
+    for (ut = p->p_uthreads; ut != NULL; ut = ut->ut_next) {
+      if (ut->ut_tid == tid) {
+        break;
+      }
+    }
+    if (ut == NULL) {
+      lock_release(p->p_lck);
+      return ESRCH;
+    }
+    if (ut == curthread->t_uthread || ut->ut_joining) {
+      lock_release(p->p_lck);
+      return EINVAL;
+    }
+
+    ut->ut_joining = true;
+    while (!ut->ut_exited && !p->p_exiting) {
+      cv_wait(p->p_threadcv, p->p_lck);
+    }
+    if (!ut->ut_exited) {
+      /* the process is exiting; we'll leave on the way out */
+      ut->ut_joining = false;
+      lock_release(p->p_lck);
+      return EINTR;
+    }
+
+    for (utp = &p->p_uthreads; *utp != ut; utp = &(*utp)->ut_next);
+    *utp = ut->ut_next;
+    lock_release(p->p_lck);
+
+    rv = ut->ut_retval;
+    kfree(ut);
+    if (retvalp != NULL) {
+      return copyout(&rv, retvalp, sizeof(int));
+    }
+    return 0;
+  }
+#endif
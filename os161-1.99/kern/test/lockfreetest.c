@@ -0,0 +1,258 @@
+/*
+ * Copyright (c) 2000, 2001, 2002, 2003, 2004, 2005, 2008, 2009
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/*
+ * Stress test for the lock-free MPSC queue and SPSC byte ring.
+ *
+ * Producer threads are spread over all cpus and the menu thread is
+ * the consumer, so puts and gets really do overlap. The queue and
+ * ring are kept small so they fill up and wrap many times over.
+ */
+
+#include <types.h>
+#include <lib.h>
+#include <cpu.h>
+#include <thread.h>
+#include <synch.h>
+#include <mpscq.h>
+#include <spscring.h>
+#include <test.h>
+
+#define LF_NPRODUCERS	8
+#define LF_NITEMS	2000
+#define LF_QSIZE	16
+
+#define LF_RINGSIZE	64
+#define LF_NBYTES	65536
+#define LF_MAXCHUNK	37	/* odd, so chunks straddle the wrap */
+
+static struct mpscq lfq;
+static struct mpscq_slot lfqslots[LF_QSIZE];
+static struct spscring lfring;
+static char lfringbuf[LF_RINGSIZE];
+static struct latch *lfdone;
+static volatile unsigned lffulls;
+static volatile bool lfstop;	/* consumer saw bad data; give up */
+
+/* Item I from producer P; never NULL. */
+#define LF_ITEM(p, i)	((void *)(((p) << 16) | ((i) + 1)))
+#define LF_PRODUCER(v)	((unsigned)(v) >> 16)
+#define LF_SEQ(v)	(((unsigned)(v) & 0xffff) - 1)
+
+static
+void
+lfqproducer(void *junk, unsigned long p)
+{
+	unsigned i;
+
+	(void)junk;
+
+	for (i=0; i<LF_NITEMS && !lfstop; i++) {
+		while (!mpscq_put(&lfq, LF_ITEM(p, i))) {
+			if (lfstop) {
+				break;
+			}
+			lffulls++;
+			thread_yield();
+		}
+	}
+	latch_countdown(lfdone);
+}
+
+static
+bool
+lfqtest(void)
+{
+	unsigned next[LF_NPRODUCERS];
+	unsigned p, got, ncpus;
+	void *v;
+	bool ok = true;
+	int result;
+
+	mpscq_init(&lfq, lfqslots, LF_QSIZE);
+	lfdone = latch_create("lfdone", LF_NPRODUCERS);
+	if (lfdone == NULL) {
+		panic("lockfreetest: latch_create failed\n");
+	}
+	lffulls = 0;
+	lfstop = false;
+
+	ncpus = cpu_count();
+	for (p=0; p<LF_NPRODUCERS; p++) {
+		next[p] = 0;
+		result = thread_fork_oncpu("lfqproducer", NULL, p % ncpus,
+					   lfqproducer, NULL, p);
+		if (result) {
+			panic("lockfreetest: thread_fork failed: %s\n",
+			      strerror(result));
+		}
+	}
+
+	/* Each producer's items must come out in order, exactly once. */
+	got = 0;
+	while (got < LF_NPRODUCERS * LF_NITEMS) {
+		v = mpscq_get(&lfq);
+		if (v == NULL) {
+			thread_yield();
+			continue;
+		}
+		p = LF_PRODUCER(v);
+		if (p >= LF_NPRODUCERS || LF_SEQ(v) != next[p]) {
+			kprintf("lockfreetest: got item %u from %u, "
+				"expected %u\n", LF_SEQ(v), p,
+				p < LF_NPRODUCERS ? next[p] : 0);
+			ok = false;
+			/* producers may be stuck on a full queue */
+			lfstop = true;
+			break;
+		}
+		next[p]++;
+		got++;
+	}
+
+	latch_wait(lfdone);
+	latch_destroy(lfdone);
+	if (ok && !mpscq_empty(&lfq)) {
+		kprintf("lockfreetest: queue not empty at the end\n");
+		ok = false;
+	}
+	kprintf("mpscq: %u items from %d producers, %u full retries\n",
+		got, LF_NPRODUCERS, lffulls);
+	return ok;
+}
+
+static
+void
+lfringproducer(void *junk, unsigned long junk2)
+{
+	char buf[LF_MAXCHUNK];
+	unsigned pos, len, i, done;
+
+	(void)junk;
+	(void)junk2;
+
+	pos = 0;
+	len = 1;
+	while (pos < LF_NBYTES) {
+		if (len > LF_NBYTES - pos) {
+			len = LF_NBYTES - pos;
+		}
+		for (i=0; i<len; i++) {
+			buf[i] = (pos + i) % 251;
+		}
+		done = 0;
+		while (done < len) {
+			if (lfstop) {
+				latch_countdown(lfdone);
+				return;
+			}
+			done += spscring_write(&lfring, buf + done,
+					       len - done);
+			if (done < len) {
+				lffulls++;
+				thread_yield();
+			}
+		}
+		pos += len;
+		len = len % LF_MAXCHUNK + 1;
+	}
+	latch_countdown(lfdone);
+}
+
+static
+bool
+lfringtest(void)
+{
+	char buf[LF_MAXCHUNK];
+	unsigned pos, len, got, i;
+	int result;
+
+	spscring_init(&lfring, lfringbuf, LF_RINGSIZE);
+	lfdone = latch_create("lfdone", 1);
+	if (lfdone == NULL) {
+		panic("lockfreetest: latch_create failed\n");
+	}
+	lffulls = 0;
+	lfstop = false;
+
+	result = thread_fork_oncpu("lfringproducer", NULL, 1 % cpu_count(),
+				   lfringproducer, NULL, 0);
+	if (result) {
+		panic("lockfreetest: thread_fork failed: %s\n",
+		      strerror(result));
+	}
+
+	/* Read in chunk sizes that don't match the writer's. */
+	pos = 0;
+	len = LF_MAXCHUNK;
+	while (pos < LF_NBYTES) {
+		got = spscring_read(&lfring, buf, len);
+		if (got == 0) {
+			thread_yield();
+			continue;
+		}
+		for (i=0; i<got; i++) {
+			if (buf[i] != (char)((pos + i) % 251)) {
+				kprintf("lockfreetest: ring byte %u is %d, "
+					"expected %d\n", pos + i, buf[i],
+					(char)((pos + i) % 251));
+				lfstop = true;
+				latch_wait(lfdone);
+				latch_destroy(lfdone);
+				return false;
+			}
+		}
+		pos += got;
+		len = len > 1 ? len - 1 : LF_MAXCHUNK;
+	}
+
+	latch_wait(lfdone);
+	latch_destroy(lfdone);
+	if (spscring_used(&lfring) != 0) {
+		kprintf("lockfreetest: ring not empty at the end\n");
+		return false;
+	}
+	kprintf("spscring: %u bytes, %u full retries\n", pos, lffulls);
+	return true;
+}
+
+int
+lockfreetest(int nargs, char **args)
+{
+	bool ok;
+
+	(void)nargs;
+	(void)args;
+
+	kprintf("Starting lock-free queue test...\n");
+	ok = lfqtest();
+	ok = lfringtest() && ok;
+	kprintf("Lock-free queue test %s.\n", ok ? "done" : "FAILED");
+	return 0;
+}
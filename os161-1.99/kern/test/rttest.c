@@ -0,0 +1,257 @@
+/*
+ * Copyright (c) 2000, 2001, 2002, 2003, 2004, 2005, 2008, 2009
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/*
+ * Real-time scheduling test: wakeup latency under load, normal class
+ * against real-time class, plus admission control.
+ */
+
+#include <types.h>
+#include <kern/errno.h>
+#include <lib.h>
+#include <clock.h>
+#include <cpu.h>
+#include <thread.h>
+#include <synch.h>
+#include <test.h>
+
+#define RT_NSAMPLES	200
+#define RT_HOGSPERCPU	2
+#define RT_NBUCKETS	16	/* Bucket n counts latencies < 2^n usec */
+
+/* Parameters the measuring thread is admitted with. */
+#define RT_PRIO		50
+#define RT_BUDGET	1000
+#define RT_PERIOD	10000
+
+static volatile bool rthogstop;
+static volatile uint64_t rtposted;
+static struct semaphore *rtwakesem;
+static struct semaphore *rtacksem;
+static struct latch *rtdone;
+static struct latch *rthogdone;
+
+static unsigned rthist[RT_NBUCKETS];
+static uint32_t rttotal;
+static uint32_t rtmax;
+static bool rtfailed;
+
+static
+void
+rthog(void *junk, unsigned long num)
+{
+	volatile unsigned long spin = num;
+
+	(void)junk;
+
+	while (!rthogstop) {
+		spin++;
+	}
+	latch_countdown(rthogdone);
+}
+
+static
+void
+rtwaker(void *junk, unsigned long junk2)
+{
+	int i;
+
+	(void)junk;
+	(void)junk2;
+
+	for (i=0; i<RT_NSAMPLES; i++) {
+		clocknap(1);
+		rtposted = gettime_usec();
+		V(rtwakesem);
+		P(rtacksem);
+	}
+	latch_countdown(rtdone);
+}
+
+static
+void
+rtsleeper(void *junk, unsigned long rt)
+{
+	uint32_t lat;
+	unsigned b;
+	int i, result;
+
+	(void)junk;
+
+	if (rt) {
+		result = thread_setsched(THREAD_SCHED_RT, RT_PRIO,
+					 RT_BUDGET, RT_PERIOD);
+		if (result) {
+			kprintf("rttest: thread_setsched: %s\n",
+				strerror(result));
+			rtfailed = true;
+		}
+	}
+
+	for (i=0; i<RT_NSAMPLES; i++) {
+		P(rtwakesem);
+		lat = gettime_usec() - rtposted;
+		rttotal += lat;
+		if (lat > rtmax) {
+			rtmax = lat;
+		}
+		for (b=0; b < RT_NBUCKETS-1 && (lat >> b) != 0; b++) {
+			/* nothing */
+		}
+		rthist[b]++;
+		V(rtacksem);
+	}
+	latch_countdown(rtdone);
+}
+
+static
+void
+rtrun(bool rt)
+{
+	unsigned b;
+	int result;
+
+	for (b=0; b<RT_NBUCKETS; b++) {
+		rthist[b] = 0;
+	}
+	rttotal = 0;
+	rtmax = 0;
+
+	rtdone = latch_create("rtdone", 2);
+	if (rtdone == NULL) {
+		panic("rttest: latch_create failed\n");
+	}
+
+	/* Both on the cpu the hogs are fighting over hardest. */
+	result = thread_fork_oncpu("rtsleeper", NULL, 0, rtsleeper, NULL, rt);
+	if (result) {
+		panic("rttest: thread_fork failed: %s\n", strerror(result));
+	}
+	result = thread_fork_oncpu("rtwaker", NULL, 1 % cpu_count(),
+				   rtwaker, NULL, 0);
+	if (result) {
+		panic("rttest: thread_fork failed: %s\n", strerror(result));
+	}
+	latch_wait(rtdone);
+	latch_destroy(rtdone);
+
+	kprintf("%s class: %d wakeups, avg %u usec, max %u usec\n",
+		rt ? "Real-time" : "Normal", RT_NSAMPLES,
+		(unsigned)(rttotal / RT_NSAMPLES), rtmax);
+	for (b=0; b<RT_NBUCKETS; b++) {
+		if (rthist[b] != 0) {
+			kprintf("    < %6u usec: %u\n", 1U << b, rthist[b]);
+		}
+	}
+}
+
+/*
+ * Admission control: the measuring thread's load plus our own must
+ * fit; a whole cpu's worth never does, nor do bad parameters.
+ */
+static
+void
+rtadmission(void)
+{
+	int result;
+
+	result = thread_setsched(THREAD_SCHED_RT, THREAD_RT_MAXPRIO + 1,
+				 RT_BUDGET, RT_PERIOD);
+	if (result != EINVAL) {
+		kprintf("rttest: bad priority admitted (%d)\n", result);
+		rtfailed = true;
+	}
+	result = thread_setsched(THREAD_SCHED_RT, RT_PRIO,
+				 RT_PERIOD, RT_PERIOD);
+	if (result != EBUSY) {
+		kprintf("rttest: full-cpu load admitted (%d)\n", result);
+		rtfailed = true;
+	}
+	result = thread_setsched(THREAD_SCHED_RT, RT_PRIO,
+				 RT_BUDGET, RT_PERIOD);
+	if (result) {
+		kprintf("rttest: light load refused: %s\n", strerror(result));
+		rtfailed = true;
+	}
+	result = thread_setsched(THREAD_SCHED_NORMAL, 0, 0, 0);
+	if (result) {
+		kprintf("rttest: can't leave real-time class: %s\n",
+			strerror(result));
+		rtfailed = true;
+	}
+}
+
+int
+rttest(int nargs, char **args)
+{
+	unsigned i, nhogs;
+	int result;
+
+	(void)nargs;
+	(void)args;
+
+	kprintf("Starting real-time scheduling test...\n");
+
+	rtfailed = false;
+	rtadmission();
+
+	rtwakesem = sem_create("rtwake", 0);
+	rtacksem = sem_create("rtack", 0);
+	if (rtwakesem == NULL || rtacksem == NULL) {
+		panic("rttest: sem_create failed\n");
+	}
+
+	nhogs = RT_HOGSPERCPU * cpu_count();
+	rthogdone = latch_create("rthogdone", nhogs);
+	if (rthogdone == NULL) {
+		panic("rttest: latch_create failed\n");
+	}
+	rthogstop = false;
+	for (i=0; i<nhogs; i++) {
+		result = thread_fork_oncpu("rthog", NULL, i % cpu_count(),
+					   rthog, NULL, i);
+		if (result) {
+			panic("rttest: thread_fork failed: %s\n",
+			      strerror(result));
+		}
+	}
+
+	rtrun(false);
+	rtrun(true);
+
+	rthogstop = true;
+	latch_wait(rthogdone);
+	latch_destroy(rthogdone);
+	sem_destroy(rtwakesem);
+	sem_destroy(rtacksem);
+
+	kprintf("Real-time scheduling test %s.\n",
+		rtfailed ? "FAILED" : "done");
+	return 0;
+}
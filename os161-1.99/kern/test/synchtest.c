@@ -32,9 +32,12 @@
  */
 
 #include <types.h>
+#include <kern/errno.h>
 #include <lib.h>
 #include <clock.h>
+#include <cpu.h>
 #include <thread.h>
+#include <spinlock.h>
 #include <synch.h>
 #include <test.h>
 
@@ -51,11 +54,13 @@ static struct semaphore *testsem = 0;
 static struct lock *testlock = 0;
 static struct cv *testcv = 0;
 static struct semaphore *donesem = 0;
+static struct latch *donelatch = 0;
 #else
 static struct semaphore *testsem;
 static struct lock *testlock;
 static struct cv *testcv;
 static struct semaphore *donesem;
+static struct latch *donelatch;
 #endif
 
 #ifdef UW
@@ -175,7 +180,7 @@ fail(unsigned long num, const char *msg)
 
 	lock_release(testlock);
 
-	V(donesem);
+	latch_countdown(donelatch);
 	thread_exit();
 }
 
@@ -218,7 +223,7 @@ locktestthread(void *junk, unsigned long num)
 
 		lock_release(testlock);
 	}
-	V(donesem);
+	latch_countdown(donelatch);
 #ifdef UW
   thread_exit();
 #endif
@@ -234,6 +239,10 @@ locktest(int nargs, char **args)
 	(void)args;
 
 	inititems();
+	donelatch = latch_create("donelatch", NTHREADS);
+	if (donelatch == NULL) {
+		panic("locktest: latch_create failed\n");
+	}
 	kprintf("Starting lock test...\n");
 
 	for (i=0; i<NTHREADS; i++) {
@@ -244,9 +253,9 @@ locktest(int nargs, char **args)
 			      strerror(result));
 		}
 	}
-	for (i=0; i<NTHREADS; i++) {
-		P(donesem);
-	}
+	latch_wait(donelatch);
+	latch_destroy(donelatch);
+	donelatch = NULL;
 
 #ifdef UW
   cleanitems();
@@ -287,7 +296,7 @@ cvtestthread(void *junk, unsigned long num)
 				kprintf("cv_wait took only %u ns\n", nsecs2);
 				kprintf("That's too fast... you must be "
 					"busy-looping\n");
-				V(donesem);
+				latch_countdown(donelatch);
 				thread_exit();
 			}
 
@@ -304,7 +313,7 @@ cvtestthread(void *junk, unsigned long num)
 		cv_broadcast(testcv, testlock);
 		lock_release(testlock);
 	}
-	V(donesem);
+	latch_countdown(donelatch);
 #ifdef UW
   thread_exit();
 #endif
@@ -320,6 +329,10 @@ cvtest(int nargs, char **args)
 	(void)args;
 
 	inititems();
+	donelatch = latch_create("donelatch", NTHREADS);
+	if (donelatch == NULL) {
+		panic("cvtest: latch_create failed\n");
+	}
 	kprintf("Starting CV test...\n");
 #ifdef UW
 	kprintf("%d threads should print out in reverse order %d times.\n", NTHREADS, NCVLOOPS);
@@ -336,9 +349,9 @@ cvtest(int nargs, char **args)
 			      strerror(result));
 		}
 	}
-	for (i=0; i<NTHREADS; i++) {
-		P(donesem);
-	}
+	latch_wait(donelatch);
+	latch_destroy(donelatch);
+	donelatch = NULL;
 
 #ifdef UW
   cleanitems();
@@ -347,3 +360,618 @@ cvtest(int nargs, char **args)
 
 	return 0;
 }
+
+/*
+ * Lock benchmark.
+ *
+ * Like the lock test, but with short critical sections and nothing
+ * else going on, so that the cost of the lock itself dominates. Run
+ * it on configurations with different numbers of cpus to see how the
+ * lock behaves under contention; with a spin limit of 0 the lock
+ * never spins, which gives the old sleep-only behavior to compare
+ * against. A nonzero third argument puts the lock in handoff mode.
+ */
+
+#define NLOCKBENCHLOOPS   2000
+#define LOCKBENCH_INSIDE  20
+#define LOCKBENCH_OUTSIDE 50
+
+static struct lock *benchlock;
+static struct barrier *benchstart;
+static struct latch *benchdone;
+static volatile unsigned long benchval;
+
+static
+void
+lockbenchthread(void *junk, unsigned long num)
+{
+	int i;
+	volatile int j;
+
+	(void)junk;
+	(void)num;
+
+	barrier_wait(benchstart);
+	for (i=0; i<NLOCKBENCHLOOPS; i++) {
+		lock_acquire(benchlock);
+		benchval++;
+		for (j=0; j<LOCKBENCH_INSIDE; j++);
+		lock_release(benchlock);
+
+		for (j=0; j<LOCKBENCH_OUTSIDE; j++);
+	}
+	latch_countdown(benchdone);
+}
+
+int
+lockbench(int nargs, char **args)
+{
+	int i, result, nthreads;
+#if OPT_A1
+	unsigned oldlimit;
+#endif
+	time_t secs1, secs2, secs;
+	uint32_t nsecs1, nsecs2, nsecs;
+
+	nthreads = NTHREADS;
+#if OPT_A1
+	oldlimit = lock_spinlimit;
+#endif
+	if (nargs > 4) {
+		kprintf("Usage: sy4 [threads [spinlimit [handoff]]]\n");
+		return EINVAL;
+	}
+	if (nargs > 1) {
+		nthreads = atoi(args[1]);
+		if (nthreads <= 0) {
+			kprintf("sy4: need at least one thread\n");
+			return EINVAL;
+		}
+	}
+	if (nargs > 2) {
+#if OPT_A1
+		lock_spinlimit = atoi(args[2]);
+#else
+		kprintf("sy4: spin limit needs adaptive locks\n");
+		return EINVAL;
+#endif
+	}
+
+	benchlock = lock_create("benchlock");
+	if (benchlock == NULL) {
+		panic("lockbench: lock_create failed\n");
+	}
+	benchstart = barrier_create("benchstart", nthreads + 1);
+	if (benchstart == NULL) {
+		panic("lockbench: barrier_create failed\n");
+	}
+	benchdone = latch_create("benchdone", nthreads);
+	if (benchdone == NULL) {
+		panic("lockbench: latch_create failed\n");
+	}
+	benchval = 0;
+
+#if OPT_A1
+	if (nargs > 3) {
+		lock_sethandoff(benchlock, atoi(args[3]) != 0);
+	}
+	kprintf("Starting lock benchmark: %d threads, %d loops, "
+		"spin limit %u%s...\n", nthreads, NLOCKBENCHLOOPS,
+		lock_spinlimit, benchlock->lck_handoff ? ", handoff" : "");
+#else
+	kprintf("Starting lock benchmark: %d threads, %d loops...\n",
+		nthreads, NLOCKBENCHLOOPS);
+#endif
+
+	for (i=0; i<nthreads; i++) {
+		result = thread_fork("lockbench", NULL, lockbenchthread,
+				     NULL, i);
+		if (result) {
+			panic("lockbench: thread_fork failed: %s\n",
+			      strerror(result));
+		}
+	}
+	/* Start the clock once everyone is forked and ready to go. */
+	barrier_wait(benchstart);
+	gettime(&secs1, &nsecs1);
+	latch_wait(benchdone);
+	gettime(&secs2, &nsecs2);
+	getinterval(secs1, nsecs1, secs2, nsecs2, &secs, &nsecs);
+
+	if (benchval != (unsigned long)nthreads * NLOCKBENCHLOOPS) {
+		kprintf("lockbench: count is %lu, should be %lu\n", benchval,
+			(unsigned long)nthreads * NLOCKBENCHLOOPS);
+		kprintf("Test failed\n");
+	}
+
+	kprintf("%lu.%09lu seconds\n", (unsigned long)secs,
+		(unsigned long)nsecs);
+#if OPT_A1
+	kprintf("%u spins, %u sleeps, %u missed wakeups\n",
+		benchlock->lck_nspins, benchlock->lck_nsleeps,
+		benchlock->lck_nmissed);
+	lock_spinlimit = oldlimit;
+#endif
+
+	lock_destroy(benchlock);
+	barrier_destroy(benchstart);
+	latch_destroy(benchdone);
+
+	kprintf("Lock benchmark done.\n");
+	return 0;
+}
+
+/*
+ * Lock convoy test.
+ *
+ * Workers take a lock around a critical section long enough that the
+ * holder is regularly preempted in it, while cpu hogs keep every run
+ * queue full. Without directed yield a preempted holder waits behind
+ * the hogs while the other workers pile up on the lock. The test runs
+ * once with lock_boostwaiters at 0 and once at its normal value, and
+ * prints the time and number of boosts for each.
+ */
+
+#define NCONVOYLOOPS    200
+#define CONVOY_INSIDE   20000
+#define CONVOY_OUTSIDE  100
+#define CONVOY_HOGSPERCPU 2
+
+static volatile bool convoystop;
+static struct latch *convoyhogdone;
+
+static
+void
+convoyhog(void *junk, unsigned long num)
+{
+	volatile unsigned long spin = num;
+
+	(void)junk;
+
+	while (!convoystop) {
+		spin++;
+	}
+	latch_countdown(convoyhogdone);
+}
+
+static
+void
+convoythread(void *junk, unsigned long num)
+{
+	int i;
+	volatile int j;
+
+	(void)junk;
+	(void)num;
+
+	barrier_wait(benchstart);
+	for (i=0; i<NCONVOYLOOPS; i++) {
+		lock_acquire(benchlock);
+		benchval++;
+		for (j=0; j<CONVOY_INSIDE; j++);
+		lock_release(benchlock);
+
+		for (j=0; j<CONVOY_OUTSIDE; j++);
+	}
+	latch_countdown(benchdone);
+}
+
+#if OPT_A1
+/*
+ * Hardware IPIs raised so far, over all cpus. Boosting a holder
+ * queued on another cpu sends it IPI_PREEMPT, so on a multi-cpu
+ * machine this shows whether the boosts really reach other cpus.
+ */
+static
+unsigned
+convoyipis(void)
+{
+	unsigned i, n;
+
+	n = 0;
+	for (i=0; i<cpu_count(); i++) {
+		n += cpu_get(i)->c_ipi_sent;
+	}
+	return n;
+}
+
+static
+void
+convoyrun(int nthreads, unsigned boostwaiters)
+{
+	int i, result;
+	unsigned ipis;
+	time_t secs1, secs2, secs;
+	uint32_t nsecs1, nsecs2, nsecs;
+
+	lock_boostwaiters = boostwaiters;
+	benchlock = lock_create("convoylock");
+	if (benchlock == NULL) {
+		panic("lockconvoy: lock_create failed\n");
+	}
+	benchstart = barrier_create("benchstart", nthreads + 1);
+	if (benchstart == NULL) {
+		panic("lockconvoy: barrier_create failed\n");
+	}
+	benchdone = latch_create("benchdone", nthreads);
+	if (benchdone == NULL) {
+		panic("lockconvoy: latch_create failed\n");
+	}
+	benchval = 0;
+
+	for (i=0; i<nthreads; i++) {
+		result = thread_fork("convoy", NULL, convoythread, NULL, i);
+		if (result) {
+			panic("lockconvoy: thread_fork failed: %s\n",
+			      strerror(result));
+		}
+	}
+	barrier_wait(benchstart);
+	ipis = convoyipis();
+	gettime(&secs1, &nsecs1);
+	latch_wait(benchdone);
+	gettime(&secs2, &nsecs2);
+	getinterval(secs1, nsecs1, secs2, nsecs2, &secs, &nsecs);
+	ipis = convoyipis() - ipis;
+
+	if (benchval != (unsigned long)nthreads * NCONVOYLOOPS) {
+		kprintf("lockconvoy: count is %lu, should be %lu\n", benchval,
+			(unsigned long)nthreads * NCONVOYLOOPS);
+		kprintf("Test failed\n");
+	}
+	kprintf("boost at %u waiters: %lu.%09lu seconds, %u sleeps, "
+		"%u boosts, %u IPIs\n", boostwaiters, (unsigned long)secs,
+		(unsigned long)nsecs, benchlock->lck_nsleeps,
+		benchlock->lck_nboosts, ipis);
+
+	lock_destroy(benchlock);
+	barrier_destroy(benchstart);
+	latch_destroy(benchdone);
+}
+#endif
+
+int
+lockconvoy(int nargs, char **args)
+{
+#if OPT_A1
+	int result, nthreads;
+	unsigned i, nhogs, oldboost;
+
+	nthreads = 8;
+	if (nargs > 2) {
+		kprintf("Usage: sy7 [threads]\n");
+		return EINVAL;
+	}
+	if (nargs > 1) {
+		nthreads = atoi(args[1]);
+		if (nthreads <= 0) {
+			kprintf("sy7: need at least one thread\n");
+			return EINVAL;
+		}
+	}
+
+	kprintf("Starting lock convoy test: %d threads, %d loops, "
+		"%u cpus...\n", nthreads, NCONVOYLOOPS, cpu_count());
+
+	nhogs = CONVOY_HOGSPERCPU * cpu_count();
+	convoyhogdone = latch_create("convoyhogdone", nhogs);
+	if (convoyhogdone == NULL) {
+		panic("lockconvoy: latch_create failed\n");
+	}
+	convoystop = false;
+	for (i=0; i<nhogs; i++) {
+		result = thread_fork_oncpu("convoyhog", NULL, i % cpu_count(),
+					   convoyhog, NULL, i);
+		if (result) {
+			panic("lockconvoy: thread_fork failed: %s\n",
+			      strerror(result));
+		}
+	}
+
+	oldboost = lock_boostwaiters;
+	convoyrun(nthreads, 0);
+	convoyrun(nthreads, oldboost > 0 ? oldboost :
+		  LOCK_BOOSTWAITERS_DEFAULT);
+	lock_boostwaiters = oldboost;
+
+	convoystop = true;
+	latch_wait(convoyhogdone);
+	latch_destroy(convoyhogdone);
+
+	kprintf("Lock convoy test done.\n");
+#else
+	(void)nargs;
+	(void)args;
+	kprintf("sy7: directed yield needs the OPT_A1 locks\n");
+#endif
+	return 0;
+}
+
+/*
+ * Reader-writer lock test.
+ *
+ * Readers check that every entry of a small table has the same value,
+ * which only holds if no writer is halfway through updating it. Every
+ * so often a reader upgrades to write, and writers downgrade to read
+ * before checking their own update. The test is run with 1, 2, 4, ...
+ * readers and a fixed number of writers in each mode, so the times
+ * show how well reads scale with the number of cpus.
+ */
+
+#define RWTABLESIZE       16
+#define NRWLOOPS          300
+#define RWMAXREADERS      NTHREADS
+#define RWUPGRADEEVERY    50
+
+static struct rwlock *testrw;
+static struct latch *rwdone;
+static volatile unsigned long rwtable[RWTABLESIZE];
+static volatile bool rwfailed;
+
+static
+void
+rwcheck(unsigned long num, const char *what)
+{
+	unsigned long val;
+	int i;
+
+	val = rwtable[0];
+	for (i=1; i<RWTABLESIZE; i++) {
+		if (rwtable[i] != val) {
+			kprintf("thread %lu: table torn during %s\n",
+				num, what);
+			rwfailed = true;
+			return;
+		}
+	}
+}
+
+static
+void
+rwupdate(void)
+{
+	unsigned long val;
+	int i;
+
+	val = rwtable[0] + 1;
+	for (i=0; i<RWTABLESIZE; i++) {
+		rwtable[i] = val;
+		/* give readers a chance to see a torn table */
+		if (i == RWTABLESIZE/2) {
+			thread_yield();
+		}
+	}
+}
+
+static
+void
+rwreaderthread(void *junk, unsigned long num)
+{
+	int i;
+
+	(void)junk;
+
+	for (i=0; i<NRWLOOPS; i++) {
+		rwlock_acquire_read(testrw);
+		rwcheck(num, "read");
+		if (i % RWUPGRADEEVERY == 0 && rwlock_tryupgrade(testrw)) {
+			rwupdate();
+			rwlock_release_write(testrw);
+		}
+		else {
+			rwlock_release_read(testrw);
+		}
+	}
+	latch_countdown(rwdone);
+}
+
+static
+void
+rwwriterthread(void *junk, unsigned long num)
+{
+	int i;
+
+	(void)junk;
+
+	for (i=0; i<NRWLOOPS/10; i++) {
+		rwlock_acquire_write(testrw);
+		rwupdate();
+		rwlock_downgrade(testrw);
+		rwcheck(num, "downgrade");
+		rwlock_release_read(testrw);
+	}
+	latch_countdown(rwdone);
+}
+
+static
+void
+rwtestrun(rwlock_mode_t mode, int nreaders, int nwriters)
+{
+	int i, result;
+	time_t secs1, secs2, secs;
+	uint32_t nsecs1, nsecs2, nsecs;
+
+	testrw = rwlock_create("testrw", mode);
+	if (testrw == NULL) {
+		panic("rwtest: rwlock_create failed\n");
+	}
+	rwdone = latch_create("rwdone", nreaders + nwriters);
+	if (rwdone == NULL) {
+		panic("rwtest: latch_create failed\n");
+	}
+
+	gettime(&secs1, &nsecs1);
+	for (i=0; i<nreaders + nwriters; i++) {
+		result = thread_fork("rwtest", NULL,
+				     i < nreaders ? rwreaderthread :
+				     rwwriterthread, NULL, i);
+		if (result) {
+			panic("rwtest: thread_fork failed: %s\n",
+			      strerror(result));
+		}
+	}
+	latch_wait(rwdone);
+	gettime(&secs2, &nsecs2);
+	getinterval(secs1, nsecs1, secs2, nsecs2, &secs, &nsecs);
+
+	kprintf("%s, %2d readers: %lu.%09lu seconds; "
+		"%u/%u reads waited, %u/%u writes waited, "
+		"%u upgrades (%u failed)\n",
+		mode == RW_PREFER_READERS ? "readers first" : "writers first",
+		nreaders, (unsigned long)secs, (unsigned long)nsecs,
+		testrw->rw_nreadwaits, testrw->rw_nreads,
+		testrw->rw_nwritewaits, testrw->rw_nwrites,
+		testrw->rw_nupgrades, testrw->rw_nfailedupgrades);
+
+	rwlock_destroy(testrw);
+	testrw = NULL;
+	latch_destroy(rwdone);
+	rwdone = NULL;
+}
+
+int
+rwtest(int nargs, char **args)
+{
+	int nreaders, nwriters, i;
+
+	nwriters = 2;
+	if (nargs > 2) {
+		kprintf("Usage: sy5 [writers]\n");
+		return EINVAL;
+	}
+	if (nargs == 2) {
+		nwriters = atoi(args[1]);
+	}
+
+	for (i=0; i<RWTABLESIZE; i++) {
+		rwtable[i] = 0;
+	}
+	rwfailed = false;
+
+	kprintf("Starting rwlock test with %d writers...\n", nwriters);
+	for (nreaders = 1; nreaders <= RWMAXREADERS; nreaders *= 2) {
+		rwtestrun(RW_PREFER_READERS, nreaders, nwriters);
+	}
+	for (nreaders = 1; nreaders <= RWMAXREADERS; nreaders *= 2) {
+		rwtestrun(RW_PREFER_WRITERS, nreaders, nwriters);
+	}
+
+	if (rwfailed) {
+		kprintf("Test failed\n");
+	}
+	kprintf("Rwlock test done.\n");
+	return 0;
+}
+
+/*
+ * Spinlock contention benchmark.
+ *
+ * Threads grab one spinlock over and over with a tiny critical
+ * section until the driver tells them to stop a second later. The
+ * total count shows throughput; the spread between the busiest and
+ * least busy thread shows how fair the lock is. Only meaningful with
+ * more than one cpu, since on one cpu holding a spinlock keeps other
+ * threads from running at all.
+ */
+
+#define SPINBENCH_INSIDE  5
+#define SPINBENCH_MAXTHREADS NTHREADS
+
+static struct spinlock benchspinlock;
+static volatile bool spinbenchstop;
+static volatile unsigned long spinbenchval;
+static unsigned long spinbenchcounts[SPINBENCH_MAXTHREADS];
+
+static
+void
+spinbenchthread(void *junk, unsigned long num)
+{
+	unsigned long count = 0;
+	volatile int j;
+
+	(void)junk;
+
+	barrier_wait(benchstart);
+	while (!spinbenchstop) {
+		spinlock_acquire(&benchspinlock);
+		spinbenchval++;
+		for (j=0; j<SPINBENCH_INSIDE; j++);
+		spinlock_release(&benchspinlock);
+		count++;
+	}
+	spinbenchcounts[num] = count;
+	latch_countdown(benchdone);
+}
+
+int
+spinbench(int nargs, char **args)
+{
+	int i, result, nthreads;
+	unsigned long total, min, max;
+
+	nthreads = 8;
+	if (nargs > 2) {
+		kprintf("Usage: sy6 [threads]\n");
+		return EINVAL;
+	}
+	if (nargs == 2) {
+		nthreads = atoi(args[1]);
+	}
+	if (nthreads <= 0 || nthreads > SPINBENCH_MAXTHREADS) {
+		kprintf("sy6: threads must be between 1 and %d\n",
+			SPINBENCH_MAXTHREADS);
+		return EINVAL;
+	}
+
+	benchstart = barrier_create("benchstart", nthreads + 1);
+	if (benchstart == NULL) {
+		panic("spinbench: barrier_create failed\n");
+	}
+	benchdone = latch_create("benchdone", nthreads);
+	if (benchdone == NULL) {
+		panic("spinbench: latch_create failed\n");
+	}
+	spinlock_init(&benchspinlock);
+	spinbenchstop = false;
+	spinbenchval = 0;
+
+	kprintf("Starting spinlock benchmark: %d threads for 1 second...\n",
+		nthreads);
+	for (i=0; i<nthreads; i++) {
+		result = thread_fork("spinbench", NULL, spinbenchthread,
+				     NULL, i);
+		if (result) {
+			panic("spinbench: thread_fork failed: %s\n",
+			      strerror(result));
+		}
+	}
+	barrier_wait(benchstart);
+	clocksleep(1);
+	spinbenchstop = true;
+	latch_wait(benchdone);
+
+	total = 0;
+	min = max = spinbenchcounts[0];
+	for (i=0; i<nthreads; i++) {
+		total += spinbenchcounts[i];
+		if (spinbenchcounts[i] < min) {
+			min = spinbenchcounts[i];
+		}
+		if (spinbenchcounts[i] > max) {
+			max = spinbenchcounts[i];
+		}
+	}
+	if (total != spinbenchval) {
+		kprintf("spinbench: count is %lu, should be %lu\n",
+			spinbenchval, total);
+		kprintf("Test failed\n");
+	}
+	kprintf("%lu acquisitions; per thread min %lu, max %lu\n",
+		total, min, max);
+
+	spinlock_cleanup(&benchspinlock);
+	barrier_destroy(benchstart);
+	latch_destroy(benchdone);
+	kprintf("Spinlock benchmark done.\n");
+	return 0;
+}
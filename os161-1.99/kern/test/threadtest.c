@@ -31,7 +31,10 @@
  * Thread test code.
  */
 #include <types.h>
+#include <kern/errno.h>
 #include <lib.h>
+#include <clock.h>
+#include <cpu.h>
 #include <thread.h>
 #include <synch.h>
 #include <test.h>
@@ -144,3 +147,230 @@ threadtest2(int nargs, char **args)
 
 	return 0;
 }
+
+/*
+ * Thread create/exit benchmark: fork threads that do nothing but
+ * exit, NTHREADS at a time, and time it. The optional second argument
+ * sets thread_cache_max for the run, so "tt4 N 0" shows the cost
+ * without the thread cache. (Note that dumbvm never gets back the
+ * memory for freed stacks, so large runs without the cache can run
+ * the system out of memory.)
+ */
+static
+void
+nullthread(void *junk, unsigned long num)
+{
+	(void)junk;
+	(void)num;
+
+	V(tsem);
+}
+
+int
+threadbench(int nargs, char **args)
+{
+	time_t secs1, secs2, secs;
+	uint32_t nsecs1, nsecs2, nsecs, usecs;
+	unsigned savedmax;
+	int i, j, n, nthreads, result;
+
+	nthreads = 256;
+	if (nargs > 3) {
+		kprintf("Usage: tt4 [threads [cachesize]]\n");
+		return EINVAL;
+	}
+	if (nargs >= 2) {
+		nthreads = atoi(args[1]);
+		if (nthreads <= 0) {
+			kprintf("tt4: threads must be positive\n");
+			return EINVAL;
+		}
+	}
+	savedmax = thread_cache_max;
+	if (nargs == 3) {
+		if (atoi(args[2]) < 0) {
+			kprintf("tt4: cachesize must not be negative\n");
+			return EINVAL;
+		}
+		thread_cache_max = atoi(args[2]);
+	}
+
+	init_sem();
+	kprintf("Starting thread benchmark: %d threads, cache size %u...\n",
+		nthreads, thread_cache_max);
+
+	gettime(&secs1, &nsecs1);
+	for (i=0; i<nthreads; i+=n) {
+		n = nthreads - i < NTHREADS ? nthreads - i : NTHREADS;
+		for (j=0; j<n; j++) {
+			result = thread_fork("threadbench", NULL, nullthread,
+					     NULL, i + j);
+			if (result) {
+				panic("threadbench: thread_fork failed %s\n",
+				      strerror(result));
+			}
+		}
+		for (j=0; j<n; j++) {
+			P(tsem);
+		}
+	}
+	gettime(&secs2, &nsecs2);
+	getinterval(secs1, nsecs1, secs2, nsecs2, &secs, &nsecs);
+
+	thread_cache_max = savedmax;
+
+	usecs = secs * 1000000 + nsecs / 1000;
+	kprintf("%d threads in %lu.%09lu seconds (%u usec each)\n",
+		nthreads, (unsigned long) secs, (unsigned long) nsecs,
+		usecs / nthreads);
+	kprintf("Thread benchmark done.\n");
+
+	return 0;
+}
+
+/*
+ * IPI stress test: every other cpu posts IPIs to the last cpu in a
+ * tight loop while a thread there keeps it busy. Posts coalesce while
+ * one is pending, so if the target ever loses an IPI its pending bits
+ * stay set and nothing will interrupt it again. Afterwards check that
+ * it drains and still takes a fresh IPI.
+ */
+#define IPI_NPOSTS	20000
+#define IPI_WAITSECS	5
+
+static struct cpu *ipitarget;
+static struct latch *ipidone;
+static volatile bool ipistop;
+
+static
+void
+ipiposter(void *junk, unsigned long num)
+{
+	unsigned i;
+
+	(void)junk;
+	(void)num;
+
+	for (i=0; i<IPI_NPOSTS; i++) {
+		ipi_send(ipitarget, IPI_UNIDLE);
+	}
+	latch_countdown(ipidone);
+}
+
+static
+void
+ipispinner(void *junk, unsigned long num)
+{
+	(void)junk;
+	(void)num;
+
+	while (!ipistop) {
+		thread_yield();
+	}
+	V(tsem);
+}
+
+static
+uint32_t
+ipipending(struct cpu *c)
+{
+	uint32_t pending;
+
+	spinlock_acquire(&c->c_ipi_lock);
+	pending = c->c_ipi_pending;
+	spinlock_release(&c->c_ipi_lock);
+	return pending;
+}
+
+int
+ipistress(int nargs, char **args)
+{
+	unsigned ncpus, i, sent, coalesced, received;
+	struct cpu *c;
+	bool ok = true;
+	int secs, result;
+
+	(void)nargs;
+	(void)args;
+
+	ncpus = cpu_count();
+	if (ncpus < 2) {
+		kprintf("tt5: needs at least 2 cpus\n");
+		return 0;
+	}
+
+	init_sem();
+	ipitarget = cpu_get(ncpus - 1);
+	ipidone = latch_create("ipidone", ncpus - 1);
+	if (ipidone == NULL) {
+		panic("ipistress: latch_create failed\n");
+	}
+	ipistop = false;
+
+	sent = coalesced = 0;
+	for (i=0; i<ncpus; i++) {
+		c = cpu_get(i);
+		sent -= c->c_ipi_sent;
+		coalesced -= c->c_ipi_coalesced;
+	}
+	received = -ipitarget->c_ipi_received;
+
+	kprintf("Starting IPI stress test: %u cpus posting to cpu%u...\n",
+		ncpus - 1, ncpus - 1);
+
+	result = thread_fork_oncpu("ipispinner", NULL, ncpus - 1,
+				   ipispinner, NULL, 0);
+	if (result) {
+		panic("ipistress: thread_fork failed %s\n", strerror(result));
+	}
+	for (i=0; i<ncpus - 1; i++) {
+		result = thread_fork_oncpu("ipiposter", NULL, i,
+					   ipiposter, NULL, i);
+		if (result) {
+			panic("ipistress: thread_fork failed %s\n",
+			      strerror(result));
+		}
+	}
+	latch_wait(ipidone);
+	latch_destroy(ipidone);
+	ipistop = true;
+	P(tsem);
+
+	/* Everything posted must get collected... */
+	for (secs=0; ipipending(ipitarget) != 0; secs++) {
+		if (secs == IPI_WAITSECS) {
+			kprintf("tt5: cpu%u still has IPIs 0x%x pending\n",
+				ncpus - 1, ipipending(ipitarget));
+			ok = false;
+			break;
+		}
+		clocksleep(1);
+	}
+
+	for (i=0; i<ncpus; i++) {
+		c = cpu_get(i);
+		sent += c->c_ipi_sent;
+		coalesced += c->c_ipi_coalesced;
+	}
+	received += ipitarget->c_ipi_received;
+
+	/* ...and a new post must still raise an interrupt. */
+	if (ok) {
+		i = ipitarget->c_ipi_received;
+		ipi_send(ipitarget, IPI_UNIDLE);
+		for (secs=0; ipitarget->c_ipi_received == i; secs++) {
+			if (secs == IPI_WAITSECS) {
+				kprintf("tt5: cpu%u took no further IPIs\n",
+					ncpus - 1);
+				ok = false;
+				break;
+			}
+			clocksleep(1);
+		}
+	}
+
+	kprintf("%u posts: %u raised, %u coalesced, %u taken\n",
+		(ncpus - 1) * IPI_NPOSTS, sent, coalesced, received);
+	kprintf("IPI stress test %s.\n", ok ? "done" : "FAILED");
+	return 0;
+}
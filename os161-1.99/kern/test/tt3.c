@@ -60,23 +60,28 @@ static struct wchan *waitchans[NWAITCHANS];  /* N distinct wait channels */
 
 static volatile int wakerdone;
 static struct semaphore *wakersem;
-static struct semaphore *donesem;
+static struct latch *donelatch;		/* sleepalots and computes */
+static struct latch *wakerlatch;	/* the waker */
 
 static
 void
-setup(void)
+setup(int howmanytotal)
 {
 	char tmp[16];
 	int i;
 
 	if (wakersem == NULL) {
 		wakersem = sem_create("wakersem", 1);
-		donesem = sem_create("donesem", 0);
 		for (i=0; i<NWAITCHANS; i++) {
 			snprintf(tmp, sizeof(tmp), "wc%d", i);
 			waitchans[i] = wchan_create(kstrdup(tmp));
 		}
 	}
+	donelatch = latch_create("donelatch", howmanytotal);
+	wakerlatch = latch_create("wakerlatch", 1);
+	if (donelatch == NULL || wakerlatch == NULL) {
+		panic("tt3: latch_create failed\n");
+	}
 	wakerdone = 0;
 }
 
@@ -98,7 +103,7 @@ sleepalot_thread(void *junk, unsigned long num)
 		}
 		kprintf("[%lu]", num);
 	}
-	V(donesem);
+	latch_countdown(donelatch);
 }
 
 static
@@ -127,7 +132,7 @@ waker_thread(void *junk1, unsigned long junk2)
 			thread_yield();
 		}
 	}
-	V(donesem);
+	latch_countdown(wakerlatch);
 }
 
 static
@@ -204,7 +209,7 @@ compute_thread(void *junk1, unsigned long num)
 	kfree(m2);
 	kfree(m3);
 
-	V(donesem);
+	latch_countdown(donelatch);
 }
 
 static
@@ -225,29 +230,30 @@ make_computes(int howmany)
 
 static
 void
-finish(int howmanytotal)
+finish(void)
 {
-	int i;
-	for (i=0; i<howmanytotal; i++) {
-		P(donesem);
-	}
+	latch_wait(donelatch);
 	P(wakersem);
 	wakerdone = 1;
 	V(wakersem);
-	P(donesem);
+	latch_wait(wakerlatch);
+
+	latch_destroy(donelatch);
+	latch_destroy(wakerlatch);
+	donelatch = wakerlatch = NULL;
 }
 
 static
 void
 runtest3(int nsleeps, int ncomputes)
 {
-	setup();
+	setup(nsleeps+ncomputes);
 	kprintf("Starting thread test 3 (%d [sleepalots], %d {computes}, "
 		"1 waker)\n",
 		nsleeps, ncomputes);
 	make_sleepalots(nsleeps);
 	make_computes(ncomputes);
-	finish(nsleeps+ncomputes);
+	finish();
 	kprintf("\nThread test 3 done\n");
 }
 
@@ -0,0 +1,141 @@
+/*
+ * Copyright (c) 2000, 2001, 2002, 2003, 2004, 2005, 2008, 2009
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/*
+ * Workqueue test.
+ */
+
+#include <types.h>
+#include <lib.h>
+#include <cpu.h>
+#include <synch.h>
+#include <workqueue.h>
+#include <test.h>
+
+#define WQ_NITEMS 64
+
+static struct work wqitems[WQ_NITEMS];
+static volatile unsigned wqran[WQ_NITEMS];
+static struct semaphore *wqblocksem;
+
+static
+void
+wqcount(void *junk, unsigned long num)
+{
+	(void)junk;
+	wqran[num]++;
+}
+
+static
+void
+wqblock(void *junk, unsigned long num)
+{
+	(void)junk;
+	(void)num;
+	P(wqblocksem);
+}
+
+int
+wqtest(int nargs, char **args)
+{
+	struct workqueue *wq;
+	struct work blocker;
+	unsigned i, ncpus;
+	bool failed = false;
+
+	(void)nargs;
+	(void)args;
+
+	kprintf("Starting workqueue test...\n");
+
+	wq = workqueue_create("wqtest");
+	if (wq == NULL) {
+		panic("wqtest: workqueue_create failed\n");
+	}
+	wqblocksem = sem_create("wqblocksem", 0);
+	if (wqblocksem == NULL) {
+		panic("wqtest: sem_create failed\n");
+	}
+	ncpus = cpu_count();
+
+	/* Spread items over all cpus; after a flush each has run once. */
+	for (i=0; i<WQ_NITEMS; i++) {
+		wqran[i] = 0;
+		work_init(&wqitems[i], wqcount, NULL, i);
+		workqueue_queue_on(wq, i % ncpus, &wqitems[i]);
+	}
+	workqueue_flush(wq);
+	for (i=0; i<WQ_NITEMS; i++) {
+		if (wqran[i] != 1) {
+			kprintf("wqtest: item %u ran %u times\n", i, wqran[i]);
+			failed = true;
+		}
+	}
+
+	/*
+	 * Stall cpu 0's worker, queue everything behind it, and
+	 * cancel every other item before letting it go.
+	 */
+	work_init(&blocker, wqblock, NULL, 0);
+	workqueue_queue_on(wq, 0, &blocker);
+	for (i=0; i<WQ_NITEMS; i++) {
+		wqran[i] = 0;
+		workqueue_queue_on(wq, 0, &wqitems[i]);
+	}
+	if (workqueue_queue(wq, &wqitems[0])) {
+		kprintf("wqtest: queued a pending item twice\n");
+		failed = true;
+	}
+	for (i=0; i<WQ_NITEMS; i+=2) {
+		if (!workqueue_cancel(wq, &wqitems[i])) {
+			kprintf("wqtest: couldn't cancel item %u\n", i);
+			failed = true;
+		}
+	}
+	V(wqblocksem);
+	workqueue_flush(wq);
+	for (i=0; i<WQ_NITEMS; i++) {
+		if (wqran[i] != i % 2) {
+			kprintf("wqtest: item %u ran %u times\n", i, wqran[i]);
+			failed = true;
+		}
+	}
+	if (workqueue_cancel(wq, &wqitems[1])) {
+		kprintf("wqtest: cancelled an item that already ran\n");
+		failed = true;
+	}
+
+	workqueue_printstats(wq);
+	workqueue_destroy(wq);
+	sem_destroy(wqblocksem);
+	wqblocksem = NULL;
+
+	kprintf("Workqueue test %s.\n", failed ? "FAILED" : "done");
+	return 0;
+}
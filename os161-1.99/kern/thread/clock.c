@@ -34,6 +34,7 @@
 #include <clock.h>
 #include <thread.h>
 #include <lamebus/ltimer.h>
+#include <mainbus.h>
 #include <current.h>
 
 /*
@@ -120,13 +121,24 @@ hardclock(void)
 	 */
 
 	curcpu->c_hardclocks++;
+	if (curcpu->c_isidle) {
+		/*
+		 * The timer is slowed right down while we idle, not
+		 * stopped outright. Nothing to do here; the idle loop
+		 * rechecks the run queues on the way out. Rearm the
+		 * slow tick.
+		 */
+		mainbus_hardclock_stop();
+		return;
+	}
 	if ((curcpu->c_hardclocks % SCHEDULE_HARDCLOCKS) == 0) {
 		schedule();
 	}
 	if ((curcpu->c_hardclocks % MIGRATE_HARDCLOCKS) == 0) {
 		thread_consider_migration();
 	}
-	thread_yield();
+	/* Round-robin; a real-time thread keeps the cpu from normal ones. */
+	thread_timeryield();
 }
 
 /*
@@ -0,0 +1,201 @@
+/*
+ * Copyright (c) 2000, 2001, 2002, 2003, 2004, 2005, 2008, 2009
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/*
+ * Epoch-based reclamation. See epoch.h.
+ */
+
+#include <types.h>
+#include <lib.h>
+#include <spl.h>
+#include <spinlock.h>
+#include <cpu.h>
+#include <thread.h>
+#include <current.h>
+#include <epoch.h>
+
+/*
+ * The global epoch. It only goes up, and only writers (epoch_call
+ * and epoch_synchronize) move it; readers never touch it.
+ */
+static struct spinlock epoch_lock = SPINLOCK_INITIALIZER;
+static volatile unsigned epoch_global;
+
+/*
+ * Start a new epoch and return its number. Anything unpublished
+ * before this call is unreachable to readers that start after a cpu
+ * has seen the new number.
+ */
+static
+unsigned
+epoch_advance(void)
+{
+	unsigned ret;
+
+	spinlock_acquire(&epoch_lock);
+	ret = ++epoch_global;
+	spinlock_release(&epoch_lock);
+	return ret;
+}
+
+/*
+ * Check whether every other cpu has been through a quiescent state
+ * in epoch TARGET or later. Idle cpus can't be reading, so they
+ * count. The current cpu is assumed not to be in a read section.
+ * Call with interrupts off so we don't move cpus halfway through.
+ */
+static
+bool
+epoch_passed(unsigned target)
+{
+	struct cpu *c;
+	unsigned i, num;
+
+	num = cpu_count();
+	for (i=0; i<num; i++) {
+		c = cpu_get(i);
+		if (c == curcpu->c_self || c->c_isidle) {
+			continue;
+		}
+		/* allow for wraparound */
+		if ((int)(c->c_epoch - target) < 0) {
+			return false;
+		}
+	}
+	return true;
+}
+
+void
+epoch_enter(void)
+{
+	splraise(IPL_NONE, IPL_HIGH);
+	curcpu->c_epoch_depth++;
+}
+
+void
+epoch_exit(void)
+{
+	KASSERT(curcpu->c_epoch_depth > 0);
+	curcpu->c_epoch_depth--;
+	spllower(IPL_HIGH, IPL_NONE);
+}
+
+/*
+ * Run FUNC(ARG) once all current readers are done. Falls back to
+ * waiting synchronously if we can't allocate the queue entry.
+ */
+void
+epoch_call(void (*func)(void *), void *arg)
+{
+	struct epoch_entry *ee;
+	int spl;
+
+	KASSERT(curthread->t_in_interrupt == false);
+	KASSERT(curcpu->c_epoch_depth == 0);
+
+	ee = kmalloc(sizeof(*ee));
+	if (ee == NULL) {
+		epoch_synchronize();
+		func(arg);
+		return;
+	}
+	ee->ee_next = NULL;
+	ee->ee_func = func;
+	ee->ee_arg = arg;
+	ee->ee_epoch = epoch_advance();
+
+	spl = splhigh();
+	if (curcpu->c_epoch_tail != NULL) {
+		curcpu->c_epoch_tail->ee_next = ee;
+	}
+	else {
+		curcpu->c_epoch_head = ee;
+	}
+	curcpu->c_epoch_tail = ee;
+	splx(spl);
+}
+
+/*
+ * Wait until all readers that might have started before the call
+ * are done.
+ */
+void
+epoch_synchronize(void)
+{
+	unsigned target;
+	bool done;
+	int spl;
+
+	KASSERT(curthread->t_in_interrupt == false);
+	KASSERT(curcpu->c_epoch_depth == 0);
+
+	target = epoch_advance();
+	while (1) {
+		spl = splhigh();
+		done = epoch_passed(target);
+		splx(spl);
+		if (done) {
+			break;
+		}
+		/* the other cpus switch at least once per hardclock */
+		thread_yield();
+	}
+}
+
+/*
+ * Note a quiescent state on the current cpu. Called from
+ * thread_switch with interrupts off.
+ */
+void
+epoch_quiescent(void)
+{
+	KASSERT(curcpu->c_epoch_depth == 0);
+	curcpu->c_epoch = epoch_global;
+}
+
+/*
+ * Run whatever cleanups on this cpu's list are now safe. Entries are
+ * in epoch order, so stop at the first one that isn't. Called from
+ * thread_switch with interrupts off.
+ */
+void
+epoch_reclaim(void)
+{
+	struct epoch_entry *ee;
+
+	while ((ee = curcpu->c_epoch_head) != NULL &&
+	       epoch_passed(ee->ee_epoch)) {
+		curcpu->c_epoch_head = ee->ee_next;
+		if (curcpu->c_epoch_head == NULL) {
+			curcpu->c_epoch_tail = NULL;
+		}
+		ee->ee_func(ee->ee_arg);
+		kfree(ee);
+	}
+}
@@ -0,0 +1,295 @@
+/*
+ * Copyright (c) 2000, 2001, 2002, 2003, 2004, 2005, 2008, 2009
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/*
+ * Lock contention statistics. See lockstat.h.
+ */
+
+#include <types.h>
+#include <lib.h>
+#include <clock.h>
+#include <spinlock.h>
+#include <lockstat.h>
+
+/* Longest name we keep in a snapshot. */
+#define LOCKSTAT_NAMELEN 24
+
+/*
+ * The table of everything being counted. lockstat_lock has no name,
+ * so it never registers itself.
+ */
+static struct spinlock lockstat_lock = SPINLOCK_INITIALIZER;
+static struct lockstat *lockstat_list;
+
+/*
+ * Copy of an entry taken under lockstat_lock, so we can print it
+ * without holding any spinlocks (and after the lock itself may have
+ * been destroyed).
+ */
+struct lockstat_snap {
+	char lss_name[LOCKSTAT_NAMELEN];
+	lockstat_kind_t lss_kind;
+	unsigned lss_acquires;
+	unsigned lss_contended;
+	uint64_t lss_waitusec;
+	uint32_t lss_maxwaitusec;
+	uint32_t lss_maxholdusec;
+};
+
+static const char *const lockstat_kindnames[] = {
+	"spinlock",
+	"lock",
+	"sem",
+	"cv",
+};
+
+void
+lockstat_init(struct lockstat *ls, const char *name, lockstat_kind_t kind)
+{
+	ls->ls_name = name;
+	ls->ls_kind = kind;
+	ls->ls_registered = false;
+	ls->ls_acquires = 0;
+	ls->ls_contended = 0;
+	ls->ls_waitusec = 0;
+	ls->ls_maxwaitusec = 0;
+	ls->ls_maxholdusec = 0;
+	ls->ls_holdstart = 0;
+	ls->ls_prev = NULL;
+	ls->ls_next = NULL;
+}
+
+static
+void
+lockstat_register(struct lockstat *ls)
+{
+	KASSERT(ls->ls_name != NULL);
+
+	spinlock_acquire(&lockstat_lock);
+	ls->ls_prev = NULL;
+	ls->ls_next = lockstat_list;
+	if (lockstat_list != NULL) {
+		lockstat_list->ls_prev = ls;
+	}
+	lockstat_list = ls;
+	ls->ls_registered = true;
+	spinlock_release(&lockstat_lock);
+}
+
+void
+lockstat_cleanup(struct lockstat *ls)
+{
+	if (!ls->ls_registered) {
+		return;
+	}
+
+	spinlock_acquire(&lockstat_lock);
+	if (ls->ls_prev != NULL) {
+		ls->ls_prev->ls_next = ls->ls_next;
+	}
+	else {
+		KASSERT(lockstat_list == ls);
+		lockstat_list = ls->ls_next;
+	}
+	if (ls->ls_next != NULL) {
+		ls->ls_next->ls_prev = ls->ls_prev;
+	}
+	ls->ls_prev = ls->ls_next = NULL;
+	ls->ls_registered = false;
+	spinlock_release(&lockstat_lock);
+}
+
+uint64_t
+lockstat_now(void)
+{
+	return gettime_usec();
+}
+
+/*
+ * Saturate an interval to 32 bits.
+ */
+static
+uint32_t
+lockstat_interval(uint64_t start, uint64_t end)
+{
+	if (start == 0 || end <= start) {
+		/* no clock yet, or it didn't tick */
+		return 0;
+	}
+	if (end - start > 0xffffffff) {
+		return 0xffffffff;
+	}
+	return end - start;
+}
+
+void
+lockstat_acquired(struct lockstat *ls, bool contended, uint64_t waitstart)
+{
+	uint64_t now = 0;
+	uint32_t wait;
+
+	if (!ls->ls_registered) {
+		lockstat_register(ls);
+	}
+
+	ls->ls_acquires++;
+	if (contended) {
+		now = lockstat_now();
+		wait = lockstat_interval(waitstart, now);
+		ls->ls_contended++;
+		ls->ls_waitusec += wait;
+		if (wait > ls->ls_maxwaitusec) {
+			ls->ls_maxwaitusec = wait;
+		}
+	}
+
+	if (ls->ls_kind == LOCKSTAT_SEM || ls->ls_kind == LOCKSTAT_CV) {
+		/* these aren't "held" */
+		return;
+	}
+	if (now == 0 && (ls->ls_acquires & (LOCKSTAT_HOLDSAMPLE-1)) == 0) {
+		now = lockstat_now();
+	}
+	ls->ls_holdstart = now;
+}
+
+void
+lockstat_released(struct lockstat *ls)
+{
+	uint32_t hold;
+
+	if (ls->ls_holdstart == 0) {
+		return;
+	}
+	hold = lockstat_interval(ls->ls_holdstart, lockstat_now());
+	if (hold > ls->ls_maxholdusec) {
+		ls->ls_maxholdusec = hold;
+	}
+	ls->ls_holdstart = 0;
+}
+
+/*
+ * True if LS belongs ahead of SNAP in the report: more contended
+ * acquisitions first, then more total wait.
+ */
+static
+bool
+lockstat_ranks_above(const struct lockstat *ls,
+		     const struct lockstat_snap *snap)
+{
+	if (ls->ls_contended != snap->lss_contended) {
+		return ls->ls_contended > snap->lss_contended;
+	}
+	return ls->ls_waitusec > snap->lss_waitusec;
+}
+
+void
+lockstat_dump(unsigned max)
+{
+	struct lockstat_snap *top;
+	struct lockstat *ls;
+	unsigned ntop, nlocks, i, j;
+	uint32_t total, avg;
+
+	KASSERT(max > 0);
+
+	/* kmalloc takes a spinlock of its own; do it first */
+	top = kmalloc(max * sizeof(*top));
+	if (top == NULL) {
+		kprintf("lockstat: out of memory\n");
+		return;
+	}
+	ntop = nlocks = 0;
+
+	spinlock_acquire(&lockstat_lock);
+	for (ls = lockstat_list; ls != NULL; ls = ls->ls_next) {
+		nlocks++;
+		if (ls->ls_contended > 0) {
+			/* insertion into the sorted top list */
+			for (i = ntop; i > 0; i--) {
+				if (!lockstat_ranks_above(ls, &top[i-1])) {
+					break;
+				}
+			}
+			if (i < max) {
+				if (ntop < max) {
+					ntop++;
+				}
+				for (j = ntop-1; j > i; j--) {
+					top[j] = top[j-1];
+				}
+				snprintf(top[i].lss_name, LOCKSTAT_NAMELEN,
+					 "%s", ls->ls_name);
+				top[i].lss_kind = ls->ls_kind;
+				top[i].lss_acquires = ls->ls_acquires;
+				top[i].lss_contended = ls->ls_contended;
+				top[i].lss_waitusec = ls->ls_waitusec;
+				top[i].lss_maxwaitusec = ls->ls_maxwaitusec;
+				top[i].lss_maxholdusec = ls->ls_maxholdusec;
+			}
+		}
+
+		/*
+		 * Reset. We don't hold the primitive's own lock, so an
+		 * update racing with this may be lost; that's fine for
+		 * statistics. Leave ls_holdstart alone so a hold in
+		 * progress still gets timed.
+		 */
+		ls->ls_acquires = 0;
+		ls->ls_contended = 0;
+		ls->ls_waitusec = 0;
+		ls->ls_maxwaitusec = 0;
+		ls->ls_maxholdusec = 0;
+	}
+	spinlock_release(&lockstat_lock);
+
+	if (ntop == 0) {
+		kprintf("No lock contention among %u locks.\n", nlocks);
+		kfree(top);
+		return;
+	}
+
+	kprintf("Top %u contended of %u locks (times in usec):\n",
+		ntop, nlocks);
+	kprintf("%-8s %-23s %9s %9s %9s %9s %9s\n", "kind", "name",
+		"acquires", "contended", "avg wait", "max wait", "max hold");
+	for (i=0; i<ntop; i++) {
+		/* stay in 32 bits; there's no 64-bit divide in here */
+		total = top[i].lss_waitusec > 0xffffffff ?
+			0xffffffff : top[i].lss_waitusec;
+		avg = total / top[i].lss_contended;
+		kprintf("%-8s %-23s %9u %9u %9u %9u %9u\n",
+			lockstat_kindnames[top[i].lss_kind],
+			top[i].lss_name,
+			top[i].lss_acquires, top[i].lss_contended,
+			avg, top[i].lss_maxwaitusec,
+			top[i].lss_maxholdusec);
+	}
+	kfree(top);
+}
@@ -48,8 +48,16 @@
 void
 spinlock_init(struct spinlock *lk)
 {
+#if OPT_TICKETLOCK
+	spinlock_data_set(&lk->lk_next, 0);
+	spinlock_data_set(&lk->lk_serving, 0);
+#else
 	spinlock_data_set(&lk->lk_lock, 0);
+#endif
 	lk->lk_holder = NULL;
+#if OPT_LOCKSTAT
+	lockstat_init(&lk->lk_stat, NULL, LOCKSTAT_SPINLOCK);
+#endif
 }
 
 /*
@@ -59,9 +67,47 @@ void
 spinlock_cleanup(struct spinlock *lk)
 {
 	KASSERT(lk->lk_holder == NULL);
+#if OPT_TICKETLOCK
+	KASSERT(spinlock_data_get(&lk->lk_next) ==
+		spinlock_data_get(&lk->lk_serving));
+#else
 	KASSERT(spinlock_data_get(&lk->lk_lock) == 0);
+#endif
+#if OPT_LOCKSTAT
+	lockstat_cleanup(&lk->lk_stat);
+#endif
 }
 
+/*
+ * Name spinlock for lock statistics.
+ */
+void
+spinlock_setname(struct spinlock *lk, const char *name)
+{
+#if OPT_LOCKSTAT
+	KASSERT(!lk->lk_stat.ls_registered);
+	lk->lk_stat.ls_name = name;
+#else
+	(void)lk;
+	(void)name;
+#endif
+}
+
+#if OPT_LOCKSTAT
+/*
+ * Note that we're about to spin, the first time around.
+ */
+static
+void
+spinlock_contended(struct spinlock *lk, bool *contended, uint64_t *start)
+{
+	if (!*contended && lk->lk_stat.ls_name != NULL) {
+		*contended = true;
+		*start = lockstat_now();
+	}
+}
+#endif
+
 /*
  * Get the lock.
  *
@@ -73,6 +119,13 @@ void
 spinlock_acquire(struct spinlock *lk)
 {
 	struct cpu *mycpu;
+#if OPT_TICKETLOCK
+	spinlock_data_t ticket;
+#endif
+#if OPT_LOCKSTAT
+	bool contended = false;
+	uint64_t waitstart = 0;
+#endif
 
 	splraise(IPL_NONE, IPL_HIGH);
 
@@ -87,6 +140,18 @@ spinlock_acquire(struct spinlock *lk)
 		mycpu = NULL;
 	}
 
+#if OPT_TICKETLOCK
+	/*
+	 * Take a ticket and wait for our turn. Only the holder ever
+	 * writes lk_serving, so waiting is just reading it.
+	 */
+	ticket = spinlock_data_fetchadd(&lk->lk_next, 1);
+	while (spinlock_data_get(&lk->lk_serving) != ticket) {
+#if OPT_LOCKSTAT
+		spinlock_contended(lk, &contended, &waitstart);
+#endif
+	}
+#else
 	while (1) {
 		/*
 		 * Do test-test-and-set, that is, read first before
@@ -99,15 +164,28 @@ spinlock_acquire(struct spinlock *lk)
 		 * we don't.
 		 */
 		if (spinlock_data_get(&lk->lk_lock) != 0) {
+#if OPT_LOCKSTAT
+			spinlock_contended(lk, &contended, &waitstart);
+#endif
 			continue;
 		}
 		if (spinlock_data_testandset(&lk->lk_lock) != 0) {
+#if OPT_LOCKSTAT
+			spinlock_contended(lk, &contended, &waitstart);
+#endif
 			continue;
 		}
 		break;
 	}
+#endif
 
 	lk->lk_holder = mycpu;
+
+#if OPT_LOCKSTAT
+	if (lk->lk_stat.ls_name != NULL) {
+		lockstat_acquired(&lk->lk_stat, contended, waitstart);
+	}
+#endif
 }
 
 /*
@@ -121,8 +199,19 @@ spinlock_release(struct spinlock *lk)
 		KASSERT(lk->lk_holder == curcpu->c_self);
 	}
 
+#if OPT_LOCKSTAT
+	if (lk->lk_stat.ls_name != NULL) {
+		lockstat_released(&lk->lk_stat);
+	}
+#endif
 	lk->lk_holder = NULL;
+#if OPT_TICKETLOCK
+	/* let the next ticket in */
+	spinlock_data_set(&lk->lk_serving,
+			  spinlock_data_get(&lk->lk_serving) + 1);
+#else
 	spinlock_data_set(&lk->lk_lock, 0);
+#endif
 	spllower(IPL_HIGH, IPL_NONE);
 }
 
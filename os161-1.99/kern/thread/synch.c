@@ -71,6 +71,9 @@ struct semaphore *sem_create(const char *name, int initial_count) {
 
 	spinlock_init(&sem->sem_lock);
         sem->sem_count = initial_count;
+#if OPT_LOCKSTAT
+	lockstat_init(&sem->sem_stat, sem->sem_name, LOCKSTAT_SEM);
+#endif
 
         return sem;
 }
@@ -81,11 +84,19 @@ void sem_destroy(struct semaphore *sem) {
 	/* wchan_cleanup will assert if anyone's waiting on it */
 	spinlock_cleanup(&sem->sem_lock);
 	wchan_destroy(sem->sem_wchan);
+#if OPT_LOCKSTAT
+	lockstat_cleanup(&sem->sem_stat);
+#endif
         kfree(sem->sem_name);
         kfree(sem);
 }
 
 void P(struct semaphore *sem) {
+#if OPT_LOCKSTAT
+        bool contended = false;
+        uint64_t waitstart = 0;
+#endif
+
         KASSERT(sem != NULL);
 
         /*
@@ -97,6 +108,12 @@ void P(struct semaphore *sem) {
         KASSERT(curthread->t_in_interrupt == false);
 
 	spinlock_acquire(&sem->sem_lock);
+#if OPT_LOCKSTAT
+        if (sem->sem_count == 0) {
+                contended = true;
+                waitstart = lockstat_now();
+        }
+#endif
         while (sem->sem_count == 0) {
 		/*
 		 * Bridge to the wchan lock, so if someone else comes
@@ -122,6 +139,9 @@ void P(struct semaphore *sem) {
         }
         KASSERT(sem->sem_count > 0);
         sem->sem_count--;
+#if OPT_LOCKSTAT
+	lockstat_acquired(&sem->sem_stat, contended, waitstart);
+#endif
 	spinlock_release(&sem->sem_lock);
 }
 
@@ -141,6 +161,11 @@ void V(struct semaphore *sem) {
 //
 // Lock.
 
+#if OPT_A1
+unsigned lock_spinlimit = LOCK_SPINLIMIT_DEFAULT;
+unsigned lock_boostwaiters = LOCK_BOOSTWAITERS_DEFAULT;
+#endif
+
 struct lock *lock_create(const char *name) {
         struct lock *lock;
 
@@ -168,6 +193,16 @@ struct lock *lock_create(const char *name) {
                 spinlock_init(&lock->lck_lock);
                 lock->lck_ownr = NULL;
                 lock->lck_held = false;
+                lock->lck_handoff = false;
+                lock->lck_nspins = 0;
+                lock->lck_nsleeps = 0;
+                lock->lck_nmissed = 0;
+                lock->lck_nboosts = 0;
+                lock->lck_nwaiting = 0;
+                #if OPT_LOCKSTAT
+                        lockstat_init(&lock->lck_stat, lock->lck_name,
+                                      LOCKSTAT_LOCK);
+                #endif
         #else
                 lock->lk_name = kstrdup(name);
                 if (lock->lk_name == NULL) {
@@ -187,6 +222,9 @@ void lock_destroy(struct lock *lock) {
                 /* wchan_cleanup will assert if anyone's waiting on it */
                 spinlock_cleanup(&lock->lck_lock);
                 wchan_destroy(lock->lck_wchan);
+                #if OPT_LOCKSTAT
+                        lockstat_cleanup(&lock->lck_stat);
+                #endif
                 kfree(lock->lck_name);
         #else
                 kfree(lock->lk_name);
@@ -202,18 +240,96 @@ void lock_acquire(struct lock *lock) {
                 KASSERT(lock_do_i_hold(lock) != true);
                 KASSERT(curthread->t_in_interrupt != true);
 
+                struct thread *owner;
+                unsigned spins = 0;
+                #if OPT_LOCKSTAT
+                        bool contended = false;
+                        uint64_t waitstart = 0;
+                #endif
+
                 spinlock_acquire(&lock->lck_lock);
 
+                #if OPT_LOCKSTAT
+                        if (lock->lck_held == true) {
+                                contended = true;
+                                waitstart = lockstat_now();
+                        }
+                #endif
                 while (lock->lck_held == true) {
+                        /*
+                         * The holder can't release (and so can't exit)
+                         * while we hold lck_lock, so it's safe to look
+                         * at its state here. If it's on a cpu, it's on
+                         * some other cpu than ours, and it'll likely be
+                         * done before we could get to sleep and back.
+                         */
+                        owner = lock->lck_ownr;
+                        if (owner->t_state == S_RUN &&
+                            spins < lock_spinlimit) {
+                                lock->lck_nspins++;
+                                spinlock_release(&lock->lck_lock);
+
+                                /*
+                                 * Only compare the owner pointer while
+                                 * spinning; once we've let go of
+                                 * lck_lock the old holder may already
+                                 * be gone.
+                                 */
+                                while (lock->lck_held &&
+                                       lock->lck_ownr == owner &&
+                                       spins < lock_spinlimit) {
+                                        spins++;
+                                }
+
+                                spinlock_acquire(&lock->lck_lock);
+                                continue;
+                        }
+
+                        /*
+                         * If the holder is waiting for a cpu and
+                         * enough of us are waiting for it, push it
+                         * to the front. If it's queued on our cpu it
+                         * runs as soon as we're asleep.
+                         */
+                        if (owner->t_state == S_READY &&
+                            lock_boostwaiters > 0 &&
+                            lock->lck_nwaiting + 1 >= lock_boostwaiters &&
+                            thread_boost(owner)) {
+                                lock->lck_nboosts++;
+                        }
+
+                        lock->lck_nsleeps++;
+                        lock->lck_nwaiting++;
                         wchan_lock(lock->lck_wchan);
                         spinlock_release(&lock->lck_lock);
                         wchan_sleep(lock->lck_wchan);
 
                         spinlock_acquire(&lock->lck_lock);
+                        lock->lck_nwaiting--;
+                        spins = 0;
+
+                        if (lock->lck_ownr == curthread) {
+                                /* lock_release handed it to us */
+                                KASSERT(lock->lck_held == true);
+                                #if OPT_LOCKSTAT
+                                        lockstat_acquired(&lock->lck_stat,
+                                                          true, waitstart);
+                                #endif
+                                spinlock_release(&lock->lck_lock);
+                                return;
+                        }
+                        if (lock->lck_held == true) {
+                                /* someone else got in ahead of us */
+                                lock->lck_nmissed++;
+                        }
                 }
                 KASSERT(lock->lck_held != true);
                 lock->lck_held = true;
                 lock->lck_ownr = curthread;
+                #if OPT_LOCKSTAT
+                        lockstat_acquired(&lock->lck_stat, contended,
+                                          waitstart);
+                #endif
 
                 spinlock_release(&lock->lck_lock);
         #else
@@ -227,7 +343,26 @@ void lock_release(struct lock *lock) {
                 KASSERT(lock != NULL);
                 KASSERT(lock_do_i_hold(lock) != false);
 
+                struct thread *next;
+
                 spinlock_acquire(&lock->lck_lock);
+                #if OPT_LOCKSTAT
+                        lockstat_released(&lock->lck_stat);
+                #endif
+
+                if (lock->lck_handoff) {
+                        /*
+                         * Leave lck_held set and make the oldest waiter
+                         * the owner. It can't look at the lock until we
+                         * drop lck_lock, so it's fine to wake it first.
+                         */
+                        next = wchan_wakeone_thread(lock->lck_wchan);
+                        if (next != NULL) {
+                                lock->lck_ownr = next;
+                                spinlock_release(&lock->lck_lock);
+                                return;
+                        }
+                }
 
                 lock->lck_ownr = NULL;
                 lock->lck_held = false;
@@ -239,6 +374,16 @@ void lock_release(struct lock *lock) {
         #endif
 }
 
+#if OPT_A1
+void lock_sethandoff(struct lock *lock, bool handoff) {
+        KASSERT(lock != NULL);
+
+        spinlock_acquire(&lock->lck_lock);
+        lock->lck_handoff = handoff;
+        spinlock_release(&lock->lck_lock);
+}
+#endif
+
 bool lock_do_i_hold(struct lock *lock) {
         #if OPT_A1
                 // Write this
@@ -276,6 +421,10 @@ struct cv *cv_create(const char *name) {
                         kfree(cv);
                         return NULL;
                 }
+                #if OPT_LOCKSTAT
+                        lockstat_init(&cv->cv_stat, cv->cv_name,
+                                      LOCKSTAT_CV);
+                #endif
         #endif
         
         return cv;
@@ -287,6 +436,9 @@ void cv_destroy(struct cv *cv) {
         #if OPT_A1
                 // add stuff here as needed
                 wchan_destroy(cv->cv_wchan);
+                #if OPT_LOCKSTAT
+                        lockstat_cleanup(&cv->cv_stat);
+                #endif
         #endif
 
         kfree(cv->cv_name);
@@ -300,12 +452,26 @@ void cv_wait(struct cv *cv, struct lock *lock) {
                 KASSERT(lock != NULL);
                 KASSERT(lock_do_i_hold(lock) != false);
 
+                #if OPT_LOCKSTAT
+                        uint64_t waitstart = lockstat_now();
+                #endif
+
                 wchan_lock(cv->cv_wchan);
 
                 lock_release(lock);
                 wchan_sleep(cv->cv_wchan);
 
-                lock_acquire(lock);
+                /*
+                 * If cv_broadcast moved us onto the lock's wait
+                 * channel, a lock in handoff mode may have been
+                 * passed to us already.
+                 */
+                if (!lock_do_i_hold(lock)) {
+                        lock_acquire(lock);
+                }
+                #if OPT_LOCKSTAT
+                        lockstat_acquired(&cv->cv_stat, true, waitstart);
+                #endif
         #else
                 (void)cv;    // suppress warning until code gets written
                 (void)lock;  // suppress warning until code gets written
@@ -333,9 +499,408 @@ void cv_broadcast(struct cv *cv, struct lock *lock) {
                 KASSERT(lock != NULL);
                 KASSERT(lock_do_i_hold(lock) != false);
 
-                wchan_wakeall(cv->cv_wchan);
+                /*
+                 * Waking everyone would just have them all race for
+                 * the lock we're holding, and all but one go straight
+                 * back to sleep. Instead move them onto the lock's
+                 * wait channel (wait morphing); lock_release then lets
+                 * them out one at a time as the lock comes free.
+                 */
+                wchan_requeue(cv->cv_wchan, lock->lck_wchan);
         #else
                 (void)cv;    // suppress warning until code gets written
                 (void)lock;  // suppress warning until code gets written
         #endif
 }
+
+////////////////////////////////////////////////////////////
+//
+// Reader-writer lock.
+
+struct rwlock *rwlock_create(const char *name, rwlock_mode_t mode) {
+        struct rwlock *rw;
+
+        KASSERT(mode == RW_PREFER_READERS || mode == RW_PREFER_WRITERS);
+
+        rw = kmalloc(sizeof(struct rwlock));
+        if (rw == NULL) {
+                return NULL;
+        }
+
+        rw->rw_name = kstrdup(name);
+        if (rw->rw_name == NULL) {
+                kfree(rw);
+                return NULL;
+        }
+
+        rw->rw_rwchan = wchan_create(rw->rw_name);
+        if (rw->rw_rwchan == NULL) {
+                kfree(rw->rw_name);
+                kfree(rw);
+                return NULL;
+        }
+        rw->rw_wwchan = wchan_create(rw->rw_name);
+        if (rw->rw_wwchan == NULL) {
+                wchan_destroy(rw->rw_rwchan);
+                kfree(rw->rw_name);
+                kfree(rw);
+                return NULL;
+        }
+        rw->rw_uwchan = wchan_create(rw->rw_name);
+        if (rw->rw_uwchan == NULL) {
+                wchan_destroy(rw->rw_wwchan);
+                wchan_destroy(rw->rw_rwchan);
+                kfree(rw->rw_name);
+                kfree(rw);
+                return NULL;
+        }
+
+        spinlock_init(&rw->rw_lock);
+        rw->rw_mode = mode;
+        rw->rw_readers = 0;
+        rw->rw_writer = NULL;
+        rw->rw_rwaiting = 0;
+        rw->rw_wwaiting = 0;
+        rw->rw_upgrading = false;
+
+        rw->rw_nreads = 0;
+        rw->rw_nwrites = 0;
+        rw->rw_nreadwaits = 0;
+        rw->rw_nwritewaits = 0;
+        rw->rw_nupgrades = 0;
+        rw->rw_nfailedupgrades = 0;
+
+        return rw;
+}
+
+void rwlock_destroy(struct rwlock *rw) {
+        KASSERT(rw != NULL);
+        KASSERT(rw->rw_readers == 0);
+        KASSERT(rw->rw_writer == NULL);
+
+        /* wchan_cleanup will assert if anyone's waiting on it */
+        spinlock_cleanup(&rw->rw_lock);
+        wchan_destroy(rw->rw_uwchan);
+        wchan_destroy(rw->rw_wwchan);
+        wchan_destroy(rw->rw_rwchan);
+        kfree(rw->rw_name);
+        kfree(rw);
+}
+
+/*
+ * Whether a new reader may take the lock right now. Call with rw_lock
+ * held.
+ */
+static bool rwlock_readable(struct rwlock *rw) {
+        if (rw->rw_writer != NULL || rw->rw_upgrading) {
+                return false;
+        }
+        if (rw->rw_mode == RW_PREFER_WRITERS && rw->rw_wwaiting > 0) {
+                return false;
+        }
+        return true;
+}
+
+/*
+ * Let the next thread(s) in after the lock has become free, or after
+ * an exclusive hold was downgraded. Call with rw_lock held.
+ *
+ * Readers are all woken at once since they can all go in together;
+ * writers are woken one at a time. Woken threads recheck the state, so
+ * waking the wrong one costs a context switch but isn't incorrect.
+ */
+static void rwlock_wakeup(struct rwlock *rw) {
+        if (rw->rw_writer != NULL) {
+                return;
+        }
+        if (rw->rw_readers == 0 && rw->rw_wwaiting > 0 &&
+            (rw->rw_mode == RW_PREFER_WRITERS || rw->rw_rwaiting == 0)) {
+                wchan_wakeone(rw->rw_wwchan);
+        }
+        else if (rw->rw_rwaiting > 0 && rwlock_readable(rw)) {
+                wchan_wakeall(rw->rw_rwchan);
+        }
+}
+
+void rwlock_acquire_read(struct rwlock *rw) {
+        KASSERT(rw != NULL);
+        KASSERT(curthread->t_in_interrupt == false);
+        KASSERT(rw->rw_writer != curthread);
+
+        spinlock_acquire(&rw->rw_lock);
+        if (!rwlock_readable(rw)) {
+                rw->rw_nreadwaits++;
+                while (!rwlock_readable(rw)) {
+                        rw->rw_rwaiting++;
+                        wchan_lock(rw->rw_rwchan);
+                        spinlock_release(&rw->rw_lock);
+                        wchan_sleep(rw->rw_rwchan);
+
+                        spinlock_acquire(&rw->rw_lock);
+                        rw->rw_rwaiting--;
+                }
+        }
+        rw->rw_readers++;
+        rw->rw_nreads++;
+        spinlock_release(&rw->rw_lock);
+}
+
+void rwlock_release_read(struct rwlock *rw) {
+        KASSERT(rw != NULL);
+
+        spinlock_acquire(&rw->rw_lock);
+        KASSERT(rw->rw_readers > 0);
+        KASSERT(rw->rw_writer == NULL);
+        rw->rw_readers--;
+        if (rw->rw_upgrading) {
+                /* the only reader left is the one upgrading */
+                if (rw->rw_readers == 1) {
+                        wchan_wakeone(rw->rw_uwchan);
+                }
+        }
+        else if (rw->rw_readers == 0) {
+                rwlock_wakeup(rw);
+        }
+        spinlock_release(&rw->rw_lock);
+}
+
+void rwlock_acquire_write(struct rwlock *rw) {
+        KASSERT(rw != NULL);
+        KASSERT(curthread->t_in_interrupt == false);
+        KASSERT(rw->rw_writer != curthread);
+
+        spinlock_acquire(&rw->rw_lock);
+        if (rw->rw_writer != NULL || rw->rw_readers > 0 ||
+            rw->rw_upgrading) {
+                rw->rw_nwritewaits++;
+                while (rw->rw_writer != NULL || rw->rw_readers > 0 ||
+                       rw->rw_upgrading) {
+                        rw->rw_wwaiting++;
+                        wchan_lock(rw->rw_wwchan);
+                        spinlock_release(&rw->rw_lock);
+                        wchan_sleep(rw->rw_wwchan);
+
+                        spinlock_acquire(&rw->rw_lock);
+                        rw->rw_wwaiting--;
+                }
+        }
+        rw->rw_writer = curthread;
+        rw->rw_nwrites++;
+        spinlock_release(&rw->rw_lock);
+}
+
+void rwlock_release_write(struct rwlock *rw) {
+        KASSERT(rw != NULL);
+        KASSERT(rwlock_do_i_write(rw));
+
+        spinlock_acquire(&rw->rw_lock);
+        KASSERT(rw->rw_readers == 0);
+        rw->rw_writer = NULL;
+        rwlock_wakeup(rw);
+        spinlock_release(&rw->rw_lock);
+}
+
+bool rwlock_tryupgrade(struct rwlock *rw) {
+        KASSERT(rw != NULL);
+        KASSERT(curthread->t_in_interrupt == false);
+
+        spinlock_acquire(&rw->rw_lock);
+        KASSERT(rw->rw_readers > 0);
+        KASSERT(rw->rw_writer == NULL);
+        if (rw->rw_upgrading) {
+                rw->rw_nfailedupgrades++;
+                spinlock_release(&rw->rw_lock);
+                return false;
+        }
+
+        /*
+         * Setting rw_upgrading keeps new readers and writers out, so
+         * we only have to wait for the readers already inside.
+         */
+        rw->rw_upgrading = true;
+        while (rw->rw_readers > 1) {
+                wchan_lock(rw->rw_uwchan);
+                spinlock_release(&rw->rw_lock);
+                wchan_sleep(rw->rw_uwchan);
+
+                spinlock_acquire(&rw->rw_lock);
+        }
+        rw->rw_upgrading = false;
+        rw->rw_readers = 0;
+        rw->rw_writer = curthread;
+        rw->rw_nupgrades++;
+        spinlock_release(&rw->rw_lock);
+        return true;
+}
+
+void rwlock_downgrade(struct rwlock *rw) {
+        KASSERT(rw != NULL);
+        KASSERT(rwlock_do_i_write(rw));
+
+        spinlock_acquire(&rw->rw_lock);
+        KASSERT(rw->rw_readers == 0);
+        rw->rw_writer = NULL;
+        rw->rw_readers = 1;
+        rw->rw_nreads++;
+        rwlock_wakeup(rw);
+        spinlock_release(&rw->rw_lock);
+}
+
+bool rwlock_do_i_write(struct rwlock *rw) {
+        return rw->rw_writer == curthread;
+}
+
+////////////////////////////////////////////////////////////
+//
+// Countdown latch.
+
+struct latch *latch_create(const char *name, unsigned count) {
+        struct latch *lt;
+
+        lt = kmalloc(sizeof(struct latch));
+        if (lt == NULL) {
+                return NULL;
+        }
+
+        lt->lt_name = kstrdup(name);
+        if (lt->lt_name == NULL) {
+                kfree(lt);
+                return NULL;
+        }
+
+        lt->lt_wchan = wchan_create(lt->lt_name);
+        if (lt->lt_wchan == NULL) {
+                kfree(lt->lt_name);
+                kfree(lt);
+                return NULL;
+        }
+
+        spinlock_init(&lt->lt_lock);
+        lt->lt_count = count;
+
+        return lt;
+}
+
+void latch_destroy(struct latch *lt) {
+        KASSERT(lt != NULL);
+
+        /*
+         * A waiter can be woken, return, and destroy the latch before
+         * the thread that woke it has let go of lt_lock. Wait for it.
+         */
+        spinlock_acquire(&lt->lt_lock);
+        spinlock_release(&lt->lt_lock);
+
+        /* wchan_cleanup will assert if anyone's waiting on it */
+        spinlock_cleanup(&lt->lt_lock);
+        wchan_destroy(lt->lt_wchan);
+        kfree(lt->lt_name);
+        kfree(lt);
+}
+
+void latch_countdown(struct latch *lt) {
+        KASSERT(lt != NULL);
+
+        spinlock_acquire(&lt->lt_lock);
+        KASSERT(lt->lt_count > 0);
+        lt->lt_count--;
+        if (lt->lt_count == 0) {
+                wchan_wakeall(lt->lt_wchan);
+        }
+        spinlock_release(&lt->lt_lock);
+}
+
+void latch_wait(struct latch *lt) {
+        KASSERT(lt != NULL);
+        KASSERT(curthread->t_in_interrupt == false);
+
+        spinlock_acquire(&lt->lt_lock);
+        if (lt->lt_count == 0) {
+                spinlock_release(&lt->lt_lock);
+                return;
+        }
+        /*
+         * The count never goes back up, and the only wakeup on this
+         * wchan is the one that brings it to zero, so there's nothing
+         * to recheck when we wake up.
+         */
+        wchan_lock(lt->lt_wchan);
+        spinlock_release(&lt->lt_lock);
+        wchan_sleep(lt->lt_wchan);
+}
+
+////////////////////////////////////////////////////////////
+//
+// Barrier.
+
+struct barrier *barrier_create(const char *name, unsigned parties) {
+        struct barrier *b;
+
+        KASSERT(parties > 0);
+
+        b = kmalloc(sizeof(struct barrier));
+        if (b == NULL) {
+                return NULL;
+        }
+
+        b->b_name = kstrdup(name);
+        if (b->b_name == NULL) {
+                kfree(b);
+                return NULL;
+        }
+
+        b->b_wchan = wchan_create(b->b_name);
+        if (b->b_wchan == NULL) {
+                kfree(b->b_name);
+                kfree(b);
+                return NULL;
+        }
+
+        spinlock_init(&b->b_lock);
+        b->b_parties = parties;
+        b->b_waiting = 0;
+        b->b_rounds = 0;
+
+        return b;
+}
+
+void barrier_destroy(struct barrier *b) {
+        KASSERT(b != NULL);
+
+        /* As in latch_destroy, let the last arrival get out first. */
+        spinlock_acquire(&b->b_lock);
+        KASSERT(b->b_waiting == 0);
+        spinlock_release(&b->b_lock);
+
+        /* wchan_cleanup will assert if anyone's waiting on it */
+        spinlock_cleanup(&b->b_lock);
+        wchan_destroy(b->b_wchan);
+        kfree(b->b_name);
+        kfree(b);
+}
+
+bool barrier_wait(struct barrier *b) {
+        KASSERT(b != NULL);
+        KASSERT(curthread->t_in_interrupt == false);
+
+        spinlock_acquire(&b->b_lock);
+        b->b_waiting++;
+        if (b->b_waiting == b->b_parties) {
+                /* last one in: start the next round and let them go */
+                b->b_waiting = 0;
+                b->b_rounds++;
+                wchan_wakeall(b->b_wchan);
+                spinlock_release(&b->b_lock);
+                return true;
+        }
+        /*
+         * Only the last arrival wakes this wchan, and it wakes
+         * everyone on it, so being woken means our round is over.
+         * Threads arriving for the next round can't be woken early,
+         * since they only get on the wchan after the wakeup.
+         */
+        wchan_lock(b->b_wchan);
+        spinlock_release(&b->b_lock);
+        wchan_sleep(b->b_wchan);
+        return false;
+}
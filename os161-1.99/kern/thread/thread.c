@@ -38,6 +38,7 @@
 #include <lib.h>
 #include <array.h>
 #include <cpu.h>
+#include <epoch.h>
 #include <spl.h>
 #include <spinlock.h>
 #include <wchan.h>
@@ -48,8 +49,10 @@
 #include <current.h>
 #include <synch.h>
 #include <addrspace.h>
+#include <clock.h>
 #include <mainbus.h>
 #include <vnode.h>
+#include <workqueue.h>
 
 #include "opt-synchprobs.h"
 
@@ -72,6 +75,13 @@ static struct cpuarray allcpus;
 /* Used to wait for secondary CPUs to come online. */
 static struct semaphore *cpu_startup_sem;
 
+/* List of all live threads, for thread_printstats. */
+static struct thread *allthreads;
+static struct spinlock allthreads_lock;
+
+static void thread_reap(void *c, unsigned long junk);
+static void exorcise(unsigned batch);
+
 ////////////////////////////////////////////////////////////
 
 /*
@@ -111,6 +121,75 @@ thread_checkstack(struct thread *thread)
 	}
 }
 
+/*
+ * Set a thread's name. Short names go in t_namebuf.
+ */
+static
+int
+thread_setname(struct thread *thread, const char *name)
+{
+	if (strlen(name) < sizeof(thread->t_namebuf)) {
+		strcpy(thread->t_namebuf, name);
+		thread->t_name = thread->t_namebuf;
+	}
+	else {
+		thread->t_name = kstrdup(name);
+		if (thread->t_name == NULL) {
+			return ENOMEM;
+		}
+	}
+	return 0;
+}
+
+static
+void
+thread_freename(struct thread *thread)
+{
+	if (thread->t_name != thread->t_namebuf) {
+		kfree(thread->t_name);
+	}
+	thread->t_name = NULL;
+}
+
+/*
+ * Set up the fields of a new thread that don't involve allocating
+ * anything. Also used on threads taken from the thread cache.
+ */
+static
+void
+thread_reset(struct thread *thread)
+{
+	thread->t_wchan_name = "NEW";
+	thread->t_state = S_READY;
+
+	/* Thread subsystem fields */
+	threadlistnode_init(&thread->t_listnode, thread);
+	thread->t_context = NULL;
+	thread->t_cpu = NULL;
+	thread->t_pinned = false;
+	thread->t_proc = NULL;
+	thread->t_uthread = NULL;
+	thread->t_schedclass = THREAD_SCHED_NORMAL;
+	thread->t_rtprio = 0;
+	thread->t_rtutil = 0;
+
+	/* Statistics fields */
+	thread->t_stamp = gettime_usec();
+	thread->t_runtime = 0;
+	thread->t_waittime = 0;
+	thread->t_nvcsw = 0;
+	thread->t_nivcsw = 0;
+	thread->t_nmigrations = 0;
+	thread->t_allprev = thread->t_allnext = NULL;
+
+	/* Interrupt state fields */
+	thread->t_in_interrupt = false;
+	thread->t_curspl = IPL_HIGH;
+	thread->t_iplhigh_count = 1; /* corresponding to t_curspl */
+
+	/* If you add to struct thread, be sure to initialize here */
+}
+
 /*
  * Create a thread. This is used both to create a first thread
  * for each CPU and to create subsequent forked threads.
@@ -128,30 +207,52 @@ thread_create(const char *name)
 		return NULL;
 	}
 
-	thread->t_name = kstrdup(name);
-	if (thread->t_name == NULL) {
+	if (thread_setname(thread, name)) {
 		kfree(thread);
 		return NULL;
 	}
-	thread->t_wchan_name = "NEW";
-	thread->t_state = S_READY;
 
-	/* Thread subsystem fields */
 	thread_machdep_init(&thread->t_machdep);
-	threadlistnode_init(&thread->t_listnode, thread);
 	thread->t_stack = NULL;
-	thread->t_context = NULL;
-	thread->t_cpu = NULL;
-	thread->t_proc = NULL;
+	thread_reset(thread);
 
-	/* Interrupt state fields */
-	thread->t_in_interrupt = false;
-	thread->t_curspl = IPL_HIGH;
-	thread->t_iplhigh_count = 1; /* corresponding to t_curspl */
+	return thread;
+}
 
-	/* If you add to struct thread, be sure to initialize here */
+/*
+ * Add a thread to, and remove it from, the list of all threads.
+ * thread_listremove is called with allthreads_lock already held.
+ */
+static
+void
+thread_listadd(struct thread *t)
+{
+	spinlock_acquire(&allthreads_lock);
+	t->t_allprev = NULL;
+	t->t_allnext = allthreads;
+	if (allthreads != NULL) {
+		allthreads->t_allprev = t;
+	}
+	allthreads = t;
+	spinlock_release(&allthreads_lock);
+}
 
-	return thread;
+static
+void
+thread_listremove(struct thread *t)
+{
+	KASSERT(spinlock_do_i_hold(&allthreads_lock));
+	if (t->t_allprev != NULL) {
+		t->t_allprev->t_allnext = t->t_allnext;
+	}
+	else {
+		KASSERT(allthreads == t);
+		allthreads = t->t_allnext;
+	}
+	if (t->t_allnext != NULL) {
+		t->t_allnext->t_allprev = t->t_allprev;
+	}
+	t->t_allprev = t->t_allnext = NULL;
 }
 
 /*
@@ -179,15 +280,31 @@ cpu_create(unsigned hardware_number)
 
 	c->c_curthread = NULL;
 	threadlist_init(&c->c_zombies);
+	threadlist_init(&c->c_threadcache);
+	threadlist_init(&c->c_reaplist);
+	work_init(&c->c_reapwork, thread_reap, c, 0);
 	c->c_hardclocks = 0;
+	c->c_starttime = gettime_usec();
+	c->c_idletime = 0;
+	c->c_interrupts = 0;
+	c->c_epoch_depth = 0;
+	c->c_epoch_head = c->c_epoch_tail = NULL;
+	c->c_epoch = 0;
 
 	c->c_isidle = false;
 	threadlist_init(&c->c_runqueue);
+	threadlist_init(&c->c_rtqueue);
+	c->c_rtutil = 0;
 	spinlock_init(&c->c_runqueue_lock);
+	spinlock_setname(&c->c_runqueue_lock, "runqueue");
 
 	c->c_ipi_pending = 0;
 	c->c_numshootdown = 0;
+	c->c_ipi_received = 0;
+	c->c_ipi_sent = 0;
+	c->c_ipi_coalesced = 0;
 	spinlock_init(&c->c_ipi_lock);
+	spinlock_setname(&c->c_ipi_lock, "ipi");
 
 	result = cpuarray_add(&allcpus, c, &c->c_number);
 	if (result != 0) {
@@ -221,12 +338,31 @@ cpu_create(unsigned hardware_number)
 		thread_checkstack_init(c->c_curthread);
 	}
 	c->c_curthread->t_cpu = c;
+	thread_listadd(c->c_curthread);
 
 	cpu_machdep_init(c);
 
 	return c;
 }
 
+/*
+ * Return the number of cpus.
+ */
+unsigned
+cpu_count(void)
+{
+	return cpuarray_num(&allcpus);
+}
+
+/*
+ * Return cpu number NUM.
+ */
+struct cpu *
+cpu_get(unsigned num)
+{
+	return cpuarray_get(&allcpus, num);
+}
+
 /*
  * Destroy a thread.
  *
@@ -258,26 +394,152 @@ thread_destroy(struct thread *thread)
 	/* sheer paranoia */
 	thread->t_wchan_name = "DESTROYED";
 
-	kfree(thread->t_name);
+	thread_freename(thread);
 	kfree(thread);
 }
 
+/*
+ * Thread cache.
+ *
+ * Rather than freeing a dead thread, exorcise() puts it on the
+ * current cpu's c_threadcache, stack and all, and thread_fork takes
+ * one from there before going to kmalloc. The cache belongs to the
+ * cpu, so the only locking needed is to keep interrupts off (which
+ * also keeps us from being switched to another cpu halfway through).
+ */
+unsigned thread_cache_max = THREAD_CACHE_MAX_DEFAULT;
+unsigned thread_reap_batch = THREAD_REAP_BATCH_DEFAULT;
+
+/*
+ * Get a thread from the cache and make it look new. Returns NULL if
+ * the cache is empty or turned off.
+ */
+static
+struct thread *
+thread_cache_get(const char *name)
+{
+	struct thread *thread;
+	int spl;
+
+	if (thread_cache_max == 0) {
+		return NULL;
+	}
+
+	spl = splhigh();
+	thread = threadlist_remhead(&curcpu->c_threadcache);
+	if (thread == NULL && !threadlist_isempty(&curcpu->c_zombies)) {
+		/* don't make the batch threshold cost us a kmalloc */
+		exorcise(1);
+		thread = threadlist_remhead(&curcpu->c_threadcache);
+	}
+	splx(spl);
+
+	if (thread == NULL) {
+		return NULL;
+	}
+	if (thread_setname(thread, name)) {
+		thread_destroy(thread);
+		return NULL;
+	}
+	thread_reset(thread);
+	return thread;
+}
+
+/*
+ * Put dead thread Z in the cache. Returns false if it's full (or Z
+ * can't be reused) and Z should be destroyed instead. Called with
+ * interrupts off.
+ */
+static
+bool
+thread_cache_put(struct thread *z)
+{
+	if (z->t_stack == NULL ||
+	    curcpu->c_threadcache.tl_count >= thread_cache_max) {
+		/* no stack: it's a boot thread */
+		return false;
+	}
+
+	KASSERT(z->t_proc == NULL);
+	thread_freename(z);
+	z->t_wchan_name = "CACHED";
+	threadlist_addhead(&curcpu->c_threadcache, z);
+	return true;
+}
+
+/*
+ * Work function that destroys the reaped threads that didn't fit in
+ * the thread cache of cpu C. Runs on C's system_wq worker, so
+ * keeping interrupts off while touching the list is enough.
+ */
+static
+void
+thread_reap(void *c_, unsigned long junk)
+{
+	struct cpu *c = c_;
+	struct thread *z;
+	int spl;
+
+	(void)junk;
+	KASSERT(c == curcpu->c_self);
+
+	while (1) {
+		spl = splhigh();
+		z = threadlist_remhead(&c->c_reaplist);
+		splx(spl);
+		if (z == NULL) {
+			break;
+		}
+		thread_destroy(z);
+	}
+}
+
 /*
  * Clean up zombies. (Zombies are threads that have exited but still
  * need to have thread_destroy called on them.)
  *
- * The list of zombies is per-cpu.
+ * The list of zombies is per-cpu. Nothing happens until there are at
+ * least BATCH of them; the whole batch is then unlinked from the list
+ * of all threads under a single acquisition of allthreads_lock,
+ * rather than taking it once per dead thread. Reaped threads go
+ * into the thread cache; the rest are handed to thread_reap so the
+ * kfrees don't land on whichever thread happens to be switched in.
+ * Before system_wq exists they're destroyed here. Called with
+ * interrupts off.
  */
 static
 void
-exorcise(void)
+exorcise(unsigned batch)
 {
 	struct thread *z;
 
-	while ((z = threadlist_remhead(&curcpu->c_zombies)) != NULL) {
+	if (curcpu->c_zombies.tl_count < batch ||
+	    threadlist_isempty(&curcpu->c_zombies)) {
+		return;
+	}
+
+	spinlock_acquire(&allthreads_lock);
+	THREADLIST_FORALL(z, curcpu->c_zombies) {
 		KASSERT(z != curthread);
 		KASSERT(z->t_state == S_ZOMBIE);
-		thread_destroy(z);
+		thread_listremove(z);
+	}
+	spinlock_release(&allthreads_lock);
+
+	while ((z = threadlist_remhead(&curcpu->c_zombies)) != NULL) {
+		if (thread_cache_put(z)) {
+			continue;
+		}
+		if (system_wq == NULL) {
+			thread_destroy(z);
+			continue;
+		}
+		threadlist_addtail(&curcpu->c_reaplist, z);
+	}
+
+	if (!threadlist_isempty(&curcpu->c_reaplist)) {
+		workqueue_queue_on(system_wq, curcpu->c_number,
+				   &curcpu->c_reapwork);
 	}
 }
 
@@ -306,6 +568,9 @@ thread_panic(void)
 	curcpu->c_runqueue.tl_count = 0;
 	curcpu->c_runqueue.tl_head.tln_next = NULL;
 	curcpu->c_runqueue.tl_tail.tln_prev = NULL;
+	curcpu->c_rtqueue.tl_count = 0;
+	curcpu->c_rtqueue.tl_head.tln_next = NULL;
+	curcpu->c_rtqueue.tl_tail.tln_prev = NULL;
 
 	/*
 	 * Ideally, we want to make sure sleeping threads don't wake
@@ -350,6 +615,9 @@ thread_bootstrap(void)
 	struct thread *bootthread;
 
 	cpuarray_init(&allcpus);
+	allthreads = NULL;
+	spinlock_init(&allthreads_lock);
+	spinlock_setname(&allthreads_lock, "allthreads");
 
 	/*
 	 * Create the cpu structure for the bootup CPU, the one we're
@@ -412,10 +680,26 @@ cpu_hatch(unsigned software_number)
 void
 thread_start_cpus(void)
 {
+	struct cpu *c;
+	uint64_t now;
 	unsigned i;
 
 	kprintf("cpu0: %s\n", cpu_identify());
 
+	/*
+	 * The clock device has attached by now; before that
+	 * gettime_usec returned 0. Restart the statistics so the
+	 * boot period isn't charged as one huge interval.
+	 */
+	now = gettime_usec();
+	for (i=0; i<cpuarray_num(&allcpus); i++) {
+		c = cpuarray_get(&allcpus, i);
+		c->c_starttime = now;
+		c->c_idletime = 0;
+		c->c_interrupts = 0;
+		c->c_curthread->t_stamp = now;
+	}
+
 	cpu_startup_sem = sem_create("cpu_hatch", 0);
 	mainbus_start_cpus();
 	
@@ -426,6 +710,47 @@ thread_start_cpus(void)
 	cpu_startup_sem = NULL;
 }
 
+/*
+ * True if real-time thread T should run in preference to RUNNING.
+ */
+static
+bool
+thread_rt_outranks(struct thread *t, struct thread *running)
+{
+	KASSERT(t->t_schedclass == THREAD_SCHED_RT);
+
+	if (running == NULL || running == t) {
+		return false;
+	}
+	if (running->t_schedclass != THREAD_SCHED_RT) {
+		return true;
+	}
+	return t->t_rtprio > running->t_rtprio;
+}
+
+/*
+ * Put real-time thread T on cpu C's real-time queue, behind any
+ * threads of the same or higher priority. Call with C's runqueue
+ * lock held.
+ */
+static
+void
+thread_rtqueue_add(struct cpu *c, struct thread *t)
+{
+	struct threadlistnode *tln;
+
+	for (tln = c->c_rtqueue.tl_head.tln_next;
+	     tln->tln_self != NULL;
+	     tln = tln->tln_next) {
+		if (tln->tln_self->t_rtprio < t->t_rtprio) {
+			threadlist_insertbefore(&c->c_rtqueue, t,
+						tln->tln_self);
+			return;
+		}
+	}
+	threadlist_addtail(&c->c_rtqueue, t);
+}
+
 /*
  * Make a thread runnable.
  *
@@ -436,7 +761,7 @@ void
 thread_make_runnable(struct thread *target, bool already_have_lock)
 {
 	struct cpu *targetcpu;
-	bool isidle;
+	bool isidle, preempt = false;
 
 	/* Lock the run queue of the target thread's cpu. */
 	targetcpu = target->t_cpu;
@@ -449,8 +774,16 @@ thread_make_runnable(struct thread *target, bool already_have_lock)
 		spinlock_acquire(&targetcpu->c_runqueue_lock);
 	}
 
+	target->t_stamp = gettime_usec();
+
 	isidle = targetcpu->c_isidle;
-	threadlist_addtail(&targetcpu->c_runqueue, target);
+	if (target->t_schedclass == THREAD_SCHED_RT) {
+		thread_rtqueue_add(targetcpu, target);
+		preempt = thread_rt_outranks(target, targetcpu->c_curthread);
+	}
+	else {
+		threadlist_addtail(&targetcpu->c_runqueue, target);
+	}
 	if (isidle) {
 		/*
 		 * Other processor is idle; send interrupt to make
@@ -458,6 +791,15 @@ thread_make_runnable(struct thread *target, bool already_have_lock)
 		 */
 		ipi_send(targetcpu, IPI_UNIDLE);
 	}
+	else if (preempt) {
+		/*
+		 * Kick whatever is running off the cpu rather than
+		 * waiting for the next hardclock. If the target is
+		 * this cpu the interrupt arrives as soon as we drop
+		 * back to spl0, which is the first safe point anyway.
+		 */
+		ipi_send(targetcpu, IPI_PREEMPT);
+	}
 
 	if (!already_have_lock) {
 		spinlock_release(&targetcpu->c_runqueue_lock);
@@ -465,20 +807,17 @@ thread_make_runnable(struct thread *target, bool already_have_lock)
 }
 
 /*
- * Create a new thread based on an existing one.
- *
- * The new thread has name NAME, and starts executing in function
- * ENTRYPOINT. DATA1 and DATA2 are passed to ENTRYPOINT.
- *
- * The new thread is created in the process P. If P is null, the
- * process is inherited from the caller. It will start on the same CPU
- * as the caller, unless the scheduler intervenes first.
+ * Common code for thread_fork and thread_fork_oncpu. If TARGETCPU is
+ * null, the new thread starts on the caller's cpu and may migrate;
+ * otherwise it is pinned to TARGETCPU.
  */
+static
 int
-thread_fork(const char *name,
-	    struct proc *proc,
-	    void (*entrypoint)(void *data1, unsigned long data2),
-	    void *data1, unsigned long data2)
+thread_fork_common(const char *name,
+		   struct proc *proc,
+		   struct cpu *targetcpu,
+		   void (*entrypoint)(void *data1, unsigned long data2),
+		   void *data1, unsigned long data2)
 {
 	struct thread *newthread;
 	int result;
@@ -487,16 +826,19 @@ thread_fork(const char *name,
 	DEBUG(DB_THREADS,"Forking thread: %s\n",name);
 #endif // UW
 
-	newthread = thread_create(name);
+	newthread = thread_cache_get(name);
 	if (newthread == NULL) {
-		return ENOMEM;
-	}
+		newthread = thread_create(name);
+		if (newthread == NULL) {
+			return ENOMEM;
+		}
 
-	/* Allocate a stack */
-	newthread->t_stack = kmalloc(STACK_SIZE);
-	if (newthread->t_stack == NULL) {
-		thread_destroy(newthread);
-		return ENOMEM;
+		/* Allocate a stack */
+		newthread->t_stack = kmalloc(STACK_SIZE);
+		if (newthread->t_stack == NULL) {
+			thread_destroy(newthread);
+			return ENOMEM;
+		}
 	}
 	thread_checkstack_init(newthread);
 
@@ -505,7 +847,13 @@ thread_fork(const char *name,
 	 */
 
 	/* Thread subsystem fields */
-	newthread->t_cpu = curthread->t_cpu;
+	if (targetcpu != NULL) {
+		newthread->t_cpu = targetcpu;
+		newthread->t_pinned = true;
+	}
+	else {
+		newthread->t_cpu = curthread->t_cpu;
+	}
 
 	/* Attach the new thread to its process */
 	if (proc == NULL) {
@@ -517,6 +865,7 @@ thread_fork(const char *name,
 		thread_destroy(newthread);
 		return result;
 	}
+	thread_listadd(newthread);
 
 	/*
 	 * Because new threads come out holding the cpu runqueue lock
@@ -528,12 +877,68 @@ thread_fork(const char *name,
 	/* Set up the switchframe so entrypoint() gets called */
 	switchframe_init(newthread, entrypoint, data1, data2);
 
-	/* Lock the current cpu's run queue and make the new thread runnable */
+	/* Lock the target cpu's run queue and make the new thread runnable */
 	thread_make_runnable(newthread, false);
 
 	return 0;
 }
 
+/*
+ * Create a new thread based on an existing one.
+ *
+ * The new thread has name NAME, and starts executing in function
+ * ENTRYPOINT. DATA1 and DATA2 are passed to ENTRYPOINT.
+ *
+ * The new thread is created in the process P. If P is null, the
+ * process is inherited from the caller. It will start on the same CPU
+ * as the caller, unless the scheduler intervenes first.
+ */
+int
+thread_fork(const char *name,
+	    struct proc *proc,
+	    void (*entrypoint)(void *data1, unsigned long data2),
+	    void *data1, unsigned long data2)
+{
+	return thread_fork_common(name, proc, NULL, entrypoint, data1, data2);
+}
+
+/*
+ * Create a new thread that runs only on cpu CPUNUM.
+ */
+int
+thread_fork_oncpu(const char *name,
+		  struct proc *proc,
+		  unsigned cpunum,
+		  void (*entrypoint)(void *data1, unsigned long data2),
+		  void *data1, unsigned long data2)
+{
+	KASSERT(cpunum < cpuarray_num(&allcpus));
+
+	return thread_fork_common(name, proc, cpuarray_get(&allcpus, cpunum),
+				  entrypoint, data1, data2);
+}
+
+/*
+ * Check if the current thread CUR, which wants to yield, has anything
+ * to yield to. Call with the runqueue lock held.
+ */
+static
+bool
+thread_yield_needed(struct thread *cur)
+{
+	struct thread *head;
+
+	if (cur->t_schedclass == THREAD_SCHED_RT) {
+		if (threadlist_isempty(&curcpu->c_rtqueue)) {
+			return false;
+		}
+		head = curcpu->c_rtqueue.tl_head.tln_next->tln_self;
+		return head->t_rtprio >= cur->t_rtprio;
+	}
+	return !threadlist_isempty(&curcpu->c_rtqueue) ||
+		!threadlist_isempty(&curcpu->c_runqueue);
+}
+
 /*
  * High level, machine-independent context switch code.
  *
@@ -548,6 +953,8 @@ void
 thread_switch(threadstate_t newstate, struct wchan *wc)
 {
 	struct thread *cur, *next;
+	uint64_t now;
+	bool idled;
 	int spl;
 
 	DEBUGASSERT(curcpu->c_curthread == curthread);
@@ -570,16 +977,39 @@ thread_switch(threadstate_t newstate, struct wchan *wc)
 	/* Check the stack guard band. */
 	thread_checkstack(cur);
 
+	/* No epoch reader can be running on this cpu now. */
+	epoch_quiescent();
+
 	/* Lock the run queue. */
 	spinlock_acquire(&curcpu->c_runqueue_lock);
 
-	/* Micro-optimization: if nothing to do, just return */
-	if (newstate == S_READY && threadlist_isempty(&curcpu->c_runqueue)) {
+	/*
+	 * If yielding and nothing we'd give way to is waiting, just
+	 * return. A real-time thread only gives way to real-time
+	 * threads of at least its own priority; a normal thread to
+	 * anything.
+	 */
+	if (newstate == S_READY && !thread_yield_needed(cur)) {
 		spinlock_release(&curcpu->c_runqueue_lock);
+		epoch_reclaim();
 		splx(spl);
 		return;
 	}
 
+	/*
+	 * Charge the time we've been running, and count the switch.
+	 * Yielding from an interrupt means hardclock or a preempt
+	 * IPI made us; anything else was our own idea.
+	 */
+	now = gettime_usec();
+	cur->t_runtime += now - cur->t_stamp;
+	if (newstate == S_READY && cur->t_in_interrupt) {
+		cur->t_nivcsw++;
+	}
+	else {
+		cur->t_nvcsw++;
+	}
+
 	/* Put the thread in the right place. */
 	switch (newstate) {
 	    case S_RUN:
@@ -627,19 +1057,40 @@ thread_switch(threadstate_t newstate, struct wchan *wc)
 	 * Note that c_isidle becomes true briefly even if we don't go
 	 * idle. However, because one is supposed to hold the runqueue
 	 * lock to look at it, this should not be visible or matter.
+	 *
+	 * An idle cpu has no use for hardclock, so stop it while we
+	 * idle; anything that gives us work sends an interrupt anyway.
 	 */
 
 	/* The current cpu is now idle. */
 	curcpu->c_isidle = true;
+	idled = false;
 	do {
-		next = threadlist_remhead(&curcpu->c_runqueue);
+		next = threadlist_remhead(&curcpu->c_rtqueue);
+		if (next == NULL) {
+			next = threadlist_remhead(&curcpu->c_runqueue);
+		}
 		if (next == NULL) {
+			if (!idled) {
+				mainbus_hardclock_stop();
+				idled = true;
+			}
+			now = gettime_usec();
 			spinlock_release(&curcpu->c_runqueue_lock);
 			cpu_idle();
 			spinlock_acquire(&curcpu->c_runqueue_lock);
+			curcpu->c_idletime += gettime_usec() - now;
 		}
 	} while (next == NULL);
 	curcpu->c_isidle = false;
+	if (idled) {
+		mainbus_hardclock_start();
+	}
+
+	/* Charge the time next spent waiting; it starts running now. */
+	now = gettime_usec();
+	next->t_waittime += now - next->t_stamp;
+	next->t_stamp = now;
 
 	/*
 	 * Note that curcpu->c_curthread may be the same variable as
@@ -711,8 +1162,11 @@ thread_switch(threadstate_t newstate, struct wchan *wc)
 	/* Activate our address space in the MMU. */
 	as_activate();
 
-	/* Clean up dead threads. */
-	exorcise();
+	/* Clean up dead threads, if enough have piled up. */
+	exorcise(thread_reap_batch);
+
+	/* Free things no epoch reader can see any more. */
+	epoch_reclaim();
 
 	/* Turn interrupts back on. */
 	splx(spl);
@@ -744,8 +1198,11 @@ thread_startup(void (*entrypoint)(void *data1, unsigned long data2),
 	/* Activate our address space in the MMU. */
 	as_activate();
 
-	/* Clean up dead threads. */
-	exorcise();
+	/* Clean up dead threads, if enough have piled up. */
+	exorcise(thread_reap_batch);
+
+	/* Free things no epoch reader can see any more. */
+	epoch_reclaim();
 
 	/* Enable interrupts. */
 	spl0();
@@ -799,6 +1256,11 @@ thread_exit(void)
 	/* Make sure we *are* detached (move this only if you're sure!) */
 	KASSERT(cur->t_proc == NULL);
 
+	/* Give back any real-time utilization we were admitted with. */
+	if (cur->t_schedclass == THREAD_SCHED_RT) {
+		thread_setsched(THREAD_SCHED_NORMAL, 0, 0, 0);
+	}
+
 	/* Check the stack guard band. */
 	thread_checkstack(cur);
 
@@ -817,8 +1279,268 @@ thread_yield(void)
 	thread_switch(S_READY, NULL);
 }
 
+/*
+ * Directed yield. T can't be freed under us: the caller knows it
+ * can't exit (e.g. it holds a lock the caller is looking at). It can
+ * be migrated, so check t_cpu again once its run queue is locked,
+ * and look for it on the queue rather than trusting t_state, since a
+ * thread in the middle of being migrated is S_READY but on no queue.
+ */
+bool
+thread_boost(struct thread *t)
+{
+	struct threadlistnode *tln;
+	struct cpu *c;
+	bool found = false;
+
+	c = t->t_cpu;
+	spinlock_acquire(&c->c_runqueue_lock);
+	if (t->t_cpu == c && t->t_state == S_READY &&
+	    t->t_schedclass == THREAD_SCHED_NORMAL) {
+		for (tln = c->c_runqueue.tl_head.tln_next;
+		     tln->tln_self != NULL;
+		     tln = tln->tln_next) {
+			if (tln->tln_self == t) {
+				found = true;
+				break;
+			}
+		}
+	}
+	if (found) {
+		threadlist_remove(&c->c_runqueue, t);
+		threadlist_addhead(&c->c_runqueue, t);
+		if (c != curcpu->c_self && !c->c_isidle) {
+			ipi_send(c, IPI_PREEMPT);
+		}
+	}
+	spinlock_release(&c->c_runqueue_lock);
+	return found;
+}
+
+/*
+ * Yield from hardclock. If nothing else is queued here there is
+ * nothing to yield to, so skip the trip through thread_switch and
+ * just note the quiescent state it would have. (The interrupt came
+ * in at spl 0, so we can't be in an epoch read section.) The queues
+ * are peeked at without the lock; a thread queued just after we look
+ * waits for the next tick, as it would have before.
+ */
+void
+thread_timeryield(void)
+{
+	if (curcpu->c_isidle) {
+		return;
+	}
+	if (curcpu->c_runqueue.tl_count == 0 &&
+	    curcpu->c_rtqueue.tl_count == 0) {
+		epoch_quiescent();
+		epoch_reclaim();
+		return;
+	}
+	thread_yield();
+}
+
 ////////////////////////////////////////////////////////////
 
+/*
+ * Scheduling classes.
+ *
+ * Admission is per cpu: a real-time thread is charged to the cpu it
+ * is on when it joins the class, and since real-time threads are
+ * never migrated it stays there until it leaves.
+ */
+unsigned thread_rt_maxutil = THREAD_RT_MAXUTIL_DEFAULT;
+
+int
+thread_setsched(int schedclass, unsigned prio,
+		uint32_t budget, uint32_t period)
+{
+	struct thread *cur;
+	unsigned util, load;
+	int spl;
+
+	cur = curthread;
+
+	switch (schedclass) {
+	    case THREAD_SCHED_NORMAL:
+		prio = 0;
+		util = 0;
+		break;
+	    case THREAD_SCHED_RT:
+		if (prio > THREAD_RT_MAXPRIO || period == 0 ||
+		    budget == 0 || budget > period) {
+			return EINVAL;
+		}
+		/*
+		 * Per mille, rounded up so many small threads can't
+		 * sneak past. Scale down first to stay in 32 bits;
+		 * there's no 64-bit divide in here.
+		 */
+		while (budget > 0xffffffff / 1000) {
+			budget >>= 1;
+			period >>= 1;
+		}
+		util = budget * 1000 / period;
+		if (util * period < budget * 1000) {
+			util++;
+		}
+		break;
+	    default:
+		return EINVAL;
+	}
+
+	/* Interrupts off so we stay on this cpu throughout. */
+	spl = splhigh();
+	spinlock_acquire(&curcpu->c_runqueue_lock);
+
+	load = curcpu->c_rtutil - cur->t_rtutil + util;
+	if (util > 0 && load > thread_rt_maxutil) {
+		spinlock_release(&curcpu->c_runqueue_lock);
+		splx(spl);
+		return EBUSY;
+	}
+	curcpu->c_rtutil = load;
+	cur->t_schedclass = schedclass;
+	cur->t_rtprio = prio;
+	cur->t_rtutil = util;
+
+	spinlock_release(&curcpu->c_runqueue_lock);
+	splx(spl);
+	return 0;
+}
+
+/*
+ * Statistics.
+ *
+ * thread_printstats copies what it needs out of each thread while
+ * holding allthreads_lock, which keeps threads from being freed, and
+ * prints afterwards. The counters themselves are read without the
+ * runqueue locks, so a line may be slightly inconsistent.
+ */
+
+#define THREADSTATS_SLACK 16	/* Room for threads forked meanwhile */
+
+struct threadstats {
+	char ts_name[THREAD_NAMELEN];
+	char ts_wchan[THREAD_NAMELEN];
+	threadstate_t ts_state;
+	unsigned ts_cpu;
+	uint64_t ts_runtime;
+	uint64_t ts_waittime;
+	unsigned ts_nvcsw;
+	unsigned ts_nivcsw;
+	unsigned ts_nmigrations;
+};
+
+/*
+ * Convert usec to msec. There's no 64-bit divide in here, so do long
+ * division 16 bits at a time; saturates after 49 days.
+ */
+static
+uint32_t
+usec_to_msec(uint64_t usec)
+{
+	uint32_t hi, lo, r, q1, q0;
+
+	hi = usec >> 32;
+	lo = (uint32_t)usec;
+	if (hi >= 1000) {
+		return 0xffffffff;
+	}
+	r = hi;
+	q1 = ((r << 16) | (lo >> 16)) / 1000;
+	r = ((r << 16) | (lo >> 16)) % 1000;
+	q0 = ((r << 16) | (lo & 0xffff)) / 1000;
+	return (q1 << 16) + q0;
+}
+
+void
+thread_printstats(void)
+{
+	static const char *const statenames[] = {
+		"run", "ready", "sleep", "zombie",
+	};
+	struct threadstats *ts;
+	struct thread *t;
+	struct cpu *c;
+	unsigned nthreads, max, i;
+	uint32_t up, idle, rate;
+
+	/* kmalloc takes a spinlock of its own; count, then allocate */
+	nthreads = 0;
+	spinlock_acquire(&allthreads_lock);
+	for (t = allthreads; t != NULL; t = t->t_allnext) {
+		nthreads++;
+	}
+	spinlock_release(&allthreads_lock);
+
+	max = nthreads + THREADSTATS_SLACK;
+	ts = kmalloc(max * sizeof(*ts));
+	if (ts == NULL) {
+		kprintf("thread_printstats: out of memory\n");
+		return;
+	}
+
+	nthreads = 0;
+	spinlock_acquire(&allthreads_lock);
+	for (t = allthreads; t != NULL && nthreads < max; t = t->t_allnext) {
+		snprintf(ts[nthreads].ts_name, THREAD_NAMELEN, "%s",
+			 t->t_name);
+		snprintf(ts[nthreads].ts_wchan, THREAD_NAMELEN, "%s",
+			 t->t_state == S_SLEEP && t->t_wchan_name != NULL ?
+			 t->t_wchan_name : "-");
+		ts[nthreads].ts_state = t->t_state;
+		ts[nthreads].ts_cpu = t->t_cpu->c_number;
+		ts[nthreads].ts_runtime = t->t_runtime;
+		ts[nthreads].ts_waittime = t->t_waittime;
+		ts[nthreads].ts_nvcsw = t->t_nvcsw;
+		ts[nthreads].ts_nivcsw = t->t_nivcsw;
+		ts[nthreads].ts_nmigrations = t->t_nmigrations;
+		nthreads++;
+	}
+	spinlock_release(&allthreads_lock);
+
+	kprintf("%-15s %-6s %3s %-15s %9s %9s %7s %7s %5s\n",
+		"thread", "state", "cpu", "wchan", "run ms", "wait ms",
+		"vcsw", "ivcsw", "migr");
+	for (i=0; i<nthreads; i++) {
+		kprintf("%-15s %-6s %3u %-15s %9u %9u %7u %7u %5u\n",
+			ts[i].ts_name, statenames[ts[i].ts_state],
+			ts[i].ts_cpu, ts[i].ts_wchan,
+			usec_to_msec(ts[i].ts_runtime),
+			usec_to_msec(ts[i].ts_waittime),
+			ts[i].ts_nvcsw, ts[i].ts_nivcsw,
+			ts[i].ts_nmigrations);
+	}
+	kfree(ts);
+
+	for (i=0; i<cpuarray_num(&allcpus); i++) {
+		c = cpuarray_get(&allcpus, i);
+		up = usec_to_msec(gettime_usec() - c->c_starttime);
+		idle = usec_to_msec(c->c_idletime);
+		rate = c->c_interrupts / (up >= 1000 ? up / 1000 : 1);
+		/* per mille; scale down so idle * 1000 fits */
+		while (up > 0xffffffff / 1000) {
+			up >>= 1;
+			idle >>= 1;
+		}
+		if (up == 0) {
+			up = 1;
+		}
+		if (idle > up) {
+			idle = up;
+		}
+		idle = idle * 1000 / up;
+		kprintf("cpu%u: %u.%u%% idle, %u hardclocks, "
+			"%u interrupts/sec\n",
+			c->c_number, idle / 10, idle % 10, c->c_hardclocks,
+			rate);
+		kprintf("      ipis: %u sent, %u coalesced, %u received\n",
+			c->c_ipi_sent, c->c_ipi_coalesced,
+			c->c_ipi_received);
+	}
+}
+
 /*
  * Scheduler.
  *
@@ -860,6 +1582,7 @@ thread_consider_migration(void)
 	struct cpu *c;
 	struct threadlist victims;
 	struct thread *t;
+	bool wake;
 
 	my_count = total_count = 0;
 	numcpus = cpuarray_num(&allcpus);
@@ -892,6 +1615,7 @@ thread_consider_migration(void)
 		if (c == curcpu->c_self) {
 			continue;
 		}
+		wake = false;
 		spinlock_acquire(&c->c_runqueue_lock);
 		while (c->c_runqueue.tl_count < one_share && to_send > 0) {
 			t = threadlist_remhead(&victims);
@@ -916,14 +1640,17 @@ thread_consider_migration(void)
 			 * the list and decrement to_send in order to
 			 * skip it. Then it goes back on our own run
 			 * queue below.
+			 *
+			 * Pinned threads are skipped the same way.
 			 */
-			if (t == curthread) {
+			if (t == curthread || t->t_pinned) {
 				threadlist_addtail(&victims, t);
 				to_send--;
 				continue;
 			}
 
 			t->t_cpu = c;
+			t->t_nmigrations++;
 			threadlist_addtail(&c->c_runqueue, t);
 			DEBUG(DB_THREADS,
 			      "Migrated thread %s: cpu %u -> %u",
@@ -931,13 +1658,19 @@ thread_consider_migration(void)
 			to_send--;
 			if (c->c_isidle) {
 				/*
-				 * Other processor is idle; send
-				 * interrupt to make sure it unidles.
+				 * Other processor is idle; it needs
+				 * an interrupt to make sure it
+				 * unidles. One will do no matter how
+				 * many threads it gets, so send it
+				 * once we're done with its queue.
 				 */
-				ipi_send(c, IPI_UNIDLE);
+				wake = true;
 			}
 		}
 		spinlock_release(&c->c_runqueue_lock);
+		if (wake) {
+			ipi_send(c, IPI_UNIDLE);
+		}
 	}
 
 	/*
@@ -1053,6 +1786,24 @@ wchan_wakeone(struct wchan *wc)
 	thread_make_runnable(target, false);
 }
 
+/*
+ * Wake up one thread sleeping on a wait channel and return it.
+ */
+struct thread *
+wchan_wakeone_thread(struct wchan *wc)
+{
+	struct thread *target;
+
+	spinlock_acquire(&wc->wc_lock);
+	target = threadlist_remhead(&wc->wc_threads);
+	spinlock_release(&wc->wc_lock);
+
+	if (target != NULL) {
+		thread_make_runnable(target, false);
+	}
+	return target;
+}
+
 /*
  * Wake up all threads sleeping on a wait channel.
  */
@@ -1090,6 +1841,26 @@ wchan_wakeall(struct wchan *wc)
 	threadlist_cleanup(&list);
 }
 
+/*
+ * Move all threads sleeping on one wait channel to another.
+ */
+void
+wchan_requeue(struct wchan *from, struct wchan *to)
+{
+	struct thread *target;
+
+	KASSERT(from != to);
+
+	spinlock_acquire(&from->wc_lock);
+	spinlock_acquire(&to->wc_lock);
+	while ((target = threadlist_remhead(&from->wc_threads)) != NULL) {
+		target->t_wchan_name = to->wc_name;
+		threadlist_addtail(&to->wc_threads, target);
+	}
+	spinlock_release(&to->wc_lock);
+	spinlock_release(&from->wc_lock);
+}
+
 /*
  * Return nonzero if there are no threads sleeping on the channel.
  * This is meant to be used only for diagnostic purposes.
@@ -1112,6 +1883,65 @@ wchan_isempty(struct wchan *wc)
  * Machine-independent IPI handling
  */
 
+/*
+ * Post IPI number CODE to TARGET, whose IPI lock must be held, and
+ * interrupt it unless that's already been done.
+ *
+ * If anything is pending, the target has been interrupted but hasn't
+ * yet run interprocessor_interrupt, which collects and clears the
+ * pending bits under the same lock; so it will see this one too, and
+ * a second hardware interrupt would only make it take the trap again
+ * to find nothing to do. This relies on the hardware IPI being
+ * acknowledged before the bits are collected (see mainbus_interrupt);
+ * otherwise a post in between would be lost for good. This matters when several cpus pile wakeups
+ * onto one idle cpu, or one cpu hands out a batch of threads.
+ *
+ * The caller's IPI statistics can be bumped without atomics since
+ * holding a spinlock keeps us on this cpu with interrupts off.
+ */
+static
+void
+ipi_post(struct cpu *target, int code)
+{
+	bool pending;
+
+	KASSERT(spinlock_do_i_hold(&target->c_ipi_lock));
+
+	pending = target->c_ipi_pending != 0;
+	target->c_ipi_pending |= (uint32_t)1 << code;
+	if (pending) {
+		curcpu->c_ipi_coalesced++;
+	}
+	else {
+		curcpu->c_ipi_sent++;
+		mainbus_send_ipi(target);
+	}
+}
+
+/*
+ * Queue a TLB shootdown on TARGET, whose IPI lock must be held.
+ */
+static
+void
+ipi_addshootdown(struct cpu *target, const struct tlbshootdown *mapping)
+{
+	int n;
+
+	KASSERT(spinlock_do_i_hold(&target->c_ipi_lock));
+
+	n = target->c_numshootdown;
+	if (n == TLBSHOOTDOWN_ALL) {
+		/* already flushing everything */
+	}
+	else if (n == TLBSHOOTDOWN_MAX) {
+		target->c_numshootdown = TLBSHOOTDOWN_ALL;
+	}
+	else {
+		target->c_shootdown[n] = *mapping;
+		target->c_numshootdown = n+1;
+	}
+}
+
 /*
  * Send an IPI (inter-processor interrupt) to the specified CPU.
  */
@@ -1121,8 +1951,7 @@ ipi_send(struct cpu *target, int code)
 	KASSERT(code >= 0 && code < 32);
 
 	spinlock_acquire(&target->c_ipi_lock);
-	target->c_ipi_pending |= (uint32_t)1 << code;
-	mainbus_send_ipi(target);
+	ipi_post(target, code);
 	spinlock_release(&target->c_ipi_lock);
 }
 
@@ -1143,26 +1972,37 @@ ipi_broadcast(int code)
 void
 ipi_tlbshootdown(struct cpu *target, const struct tlbshootdown *mapping)
 {
-	int n;
-
 	spinlock_acquire(&target->c_ipi_lock);
-
-	n = target->c_numshootdown;
-	if (n == TLBSHOOTDOWN_MAX) {
-		target->c_numshootdown = TLBSHOOTDOWN_ALL;
-	}
-	else {
-		target->c_shootdown[n] = *mapping;
-		target->c_numshootdown = n+1;
-	}
-
-	target->c_ipi_pending |= (uint32_t)1 << IPI_TLBSHOOTDOWN;
-	mainbus_send_ipi(target);
-
+	ipi_addshootdown(target, mapping);
+	ipi_post(target, IPI_TLBSHOOTDOWN);
 	spinlock_release(&target->c_ipi_lock);
 }
 
+/*
+ * Shoot down MAPPING on every other CPU in one pass, instead of a
+ * separate ipi_tlbshootdown (and hardware IPI) per CPU. CPUs that
+ * already have a shootdown pending just get the mapping added to
+ * their list.
+ */
 void
+ipi_tlbshootdown_broadcast(const struct tlbshootdown *mapping)
+{
+	unsigned i;
+	struct cpu *c;
+
+	for (i=0; i < cpuarray_num(&allcpus); i++) {
+		c = cpuarray_get(&allcpus, i);
+		if (c == curcpu->c_self) {
+			continue;
+		}
+		spinlock_acquire(&c->c_ipi_lock);
+		ipi_addshootdown(c, mapping);
+		ipi_post(c, IPI_TLBSHOOTDOWN);
+		spinlock_release(&c->c_ipi_lock);
+	}
+}
+
+bool
 interprocessor_interrupt(void)
 {
 	uint32_t bits;
@@ -1170,6 +2010,7 @@ interprocessor_interrupt(void)
 
 	spinlock_acquire(&curcpu->c_ipi_lock);
 	bits = curcpu->c_ipi_pending;
+	curcpu->c_ipi_received++;
 
 	if (bits & (1U << IPI_PANIC)) {
 		/* panic on another cpu - just stop dead */
@@ -1192,6 +2033,15 @@ interprocessor_interrupt(void)
 		 * interrupt; don't need to do anything else.
 		 */
 	}
+	if (bits & (1U << IPI_PREEMPT)) {
+		/*
+		 * A real-time thread that outranks us woke up, or a
+		 * lock holder was boosted to the front of our run
+		 * queue. Our caller yields once the interrupt has been
+		 * dealt with; thread_switch decides whether we really
+		 * lose the cpu, since the thread may already have run.
+		 */
+	}
 	if (bits & (1U << IPI_TLBSHOOTDOWN)) {
 		if (curcpu->c_numshootdown == TLBSHOOTDOWN_ALL) {
 			vm_tlbshootdown_all();
@@ -1206,4 +2056,6 @@ interprocessor_interrupt(void)
 
 	curcpu->c_ipi_pending = 0;
 	spinlock_release(&curcpu->c_ipi_lock);
+
+	return (bits & (1U << IPI_PREEMPT)) != 0;
 }
@@ -0,0 +1,491 @@
+/*
+ * Copyright (c) 2000, 2001, 2002, 2003, 2004, 2005, 2008, 2009
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/*
+ * Workqueues. See workqueue.h.
+ */
+
+#include <types.h>
+#include <lib.h>
+#include <clock.h>
+#include <spinlock.h>
+#include <wchan.h>
+#include <cpu.h>
+#include <thread.h>
+#include <current.h>
+#include <proc.h>
+#include <synch.h>
+#include <workqueue.h>
+
+/*
+ * Per-cpu part of a workqueue. Everything below wc_lock is protected
+ * by it.
+ */
+struct wq_cpu {
+	struct workqueue *wc_wq;
+	unsigned wc_cpunum;
+	struct thread *wc_worker;
+	struct wchan *wc_wchan;		/* worker sleeps here */
+	struct wchan *wc_donechan;	/* cancel and destroy sleep here */
+	struct work wc_barrier;		/* for workqueue_flush */
+	struct spinlock wc_lock;
+
+	struct work *wc_head;		/* pending items, oldest first */
+	struct work *wc_tail;
+	struct work *wc_running;	/* item being run, if any */
+	bool wc_exiting;		/* told to quit when empty */
+	bool wc_exited;			/* worker is gone */
+
+	/* statistics */
+	unsigned wc_nqueued;
+	unsigned wc_nran;
+	unsigned wc_ncancelled;
+	uint64_t wc_latency;		/* total, usec */
+	uint32_t wc_maxlatency;
+};
+
+struct workqueue {
+	char *wq_name;
+	unsigned wq_ncpus;
+	struct wq_cpu *wq_cpus;
+	struct lock *wq_flushlock;	/* one flush at a time */
+	struct semaphore *wq_flushsem;	/* barriers V this */
+};
+
+struct workqueue *system_wq;
+
+void
+work_init(struct work *w, void (*func)(void *, unsigned long),
+	  void *data1, unsigned long data2)
+{
+	w->w_func = func;
+	w->w_data1 = data1;
+	w->w_data2 = data2;
+	spinlock_data_set(&w->w_pending, 0);
+	w->w_cpu = NULL;
+	w->w_onlist = false;
+	w->w_prev = w->w_next = NULL;
+	w->w_queuedat = 0;
+}
+
+/*
+ * List handling. Call with wc_lock held.
+ */
+static
+void
+wq_cpu_append(struct wq_cpu *wc, struct work *w)
+{
+	KASSERT(!w->w_onlist);
+	w->w_next = NULL;
+	w->w_prev = wc->wc_tail;
+	if (wc->wc_tail != NULL) {
+		wc->wc_tail->w_next = w;
+	}
+	else {
+		wc->wc_head = w;
+	}
+	wc->wc_tail = w;
+	w->w_onlist = true;
+}
+
+static
+void
+wq_cpu_remove(struct wq_cpu *wc, struct work *w)
+{
+	KASSERT(w->w_onlist);
+	if (w->w_prev != NULL) {
+		w->w_prev->w_next = w->w_next;
+	}
+	else {
+		wc->wc_head = w->w_next;
+	}
+	if (w->w_next != NULL) {
+		w->w_next->w_prev = w->w_prev;
+	}
+	else {
+		wc->wc_tail = w->w_prev;
+	}
+	w->w_prev = w->w_next = NULL;
+	w->w_onlist = false;
+}
+
+/*
+ * The worker thread for one cpu.
+ */
+static
+void
+wq_worker(void *data1, unsigned long junk)
+{
+	struct wq_cpu *wc = data1;
+	struct work *w;
+	uint64_t now;
+	uint32_t latency;
+
+	(void)junk;
+
+	KASSERT(curthread->t_pinned);
+	KASSERT(curcpu->c_number == wc->wc_cpunum);
+
+	spinlock_acquire(&wc->wc_lock);
+	wc->wc_worker = curthread;
+	while (1) {
+		while (wc->wc_head == NULL && !wc->wc_exiting) {
+			wchan_lock(wc->wc_wchan);
+			spinlock_release(&wc->wc_lock);
+			wchan_sleep(wc->wc_wchan);
+			spinlock_acquire(&wc->wc_lock);
+		}
+		w = wc->wc_head;
+		if (w == NULL) {
+			/* exiting, and drained */
+			break;
+		}
+		wq_cpu_remove(wc, w);
+
+		/* From here on it may be queued again. */
+		spinlock_data_set(&w->w_pending, 0);
+		wc->wc_running = w;
+
+		now = gettime_usec();
+		if (w->w_queuedat != 0 && now > w->w_queuedat) {
+			latency = now - w->w_queuedat > 0xffffffff ?
+				0xffffffff : now - w->w_queuedat;
+			wc->wc_latency += latency;
+			if (latency > wc->wc_maxlatency) {
+				wc->wc_maxlatency = latency;
+			}
+		}
+		spinlock_release(&wc->wc_lock);
+
+		w->w_func(w->w_data1, w->w_data2);
+		/* W may be gone now */
+
+		spinlock_acquire(&wc->wc_lock);
+		wc->wc_running = NULL;
+		wc->wc_nran++;
+		wchan_wakeall(wc->wc_donechan);
+	}
+	wc->wc_exited = true;
+	wchan_wakeall(wc->wc_donechan);
+	spinlock_release(&wc->wc_lock);
+}
+
+/*
+ * Sleep on wc_donechan. Call with wc_lock held; returns with it held.
+ */
+static
+void
+wq_cpu_waitdone(struct wq_cpu *wc)
+{
+	wchan_lock(wc->wc_donechan);
+	spinlock_release(&wc->wc_lock);
+	wchan_sleep(wc->wc_donechan);
+	spinlock_acquire(&wc->wc_lock);
+}
+
+/*
+ * Barrier item for workqueue_flush.
+ */
+static
+void
+wq_barrier(void *data1, unsigned long junk)
+{
+	struct semaphore *sem = data1;
+
+	(void)junk;
+	V(sem);
+}
+
+static
+void
+wq_cpu_cleanup(struct wq_cpu *wc)
+{
+	KASSERT(wc->wc_head == NULL);
+	KASSERT(wc->wc_running == NULL);
+	if (wc->wc_donechan != NULL) {
+		wchan_destroy(wc->wc_donechan);
+	}
+	if (wc->wc_wchan != NULL) {
+		wchan_destroy(wc->wc_wchan);
+	}
+	spinlock_cleanup(&wc->wc_lock);
+}
+
+/*
+ * Tell the workers of the first NCPUS cpus to quit and wait for them.
+ */
+static
+void
+wq_stopworkers(struct workqueue *wq, unsigned ncpus)
+{
+	struct wq_cpu *wc;
+	unsigned i;
+
+	for (i=0; i<ncpus; i++) {
+		wc = &wq->wq_cpus[i];
+		spinlock_acquire(&wc->wc_lock);
+		wc->wc_exiting = true;
+		wchan_wakeone(wc->wc_wchan);
+		while (!wc->wc_exited) {
+			wq_cpu_waitdone(wc);
+		}
+		spinlock_release(&wc->wc_lock);
+	}
+}
+
+/*
+ * Free a workqueue whose workers are gone (or never started). Only
+ * the first NINIT per-cpu structures have been set up.
+ */
+static
+void
+wq_free(struct workqueue *wq, unsigned ninit)
+{
+	unsigned i;
+
+	for (i=0; i<ninit; i++) {
+		wq_cpu_cleanup(&wq->wq_cpus[i]);
+	}
+	if (wq->wq_flushsem != NULL) {
+		sem_destroy(wq->wq_flushsem);
+	}
+	if (wq->wq_flushlock != NULL) {
+		lock_destroy(wq->wq_flushlock);
+	}
+	kfree(wq->wq_cpus);
+	kfree(wq->wq_name);
+	kfree(wq);
+}
+
+struct workqueue *
+workqueue_create(const char *name)
+{
+	struct workqueue *wq;
+	struct wq_cpu *wc;
+	char namebuf[32];
+	unsigned ninit, started;
+	int result;
+
+	wq = kmalloc(sizeof(*wq));
+	if (wq == NULL) {
+		return NULL;
+	}
+	wq->wq_name = kstrdup(name);
+	if (wq->wq_name == NULL) {
+		kfree(wq);
+		return NULL;
+	}
+	wq->wq_ncpus = cpu_count();
+	wq->wq_cpus = kmalloc(wq->wq_ncpus * sizeof(struct wq_cpu));
+	if (wq->wq_cpus == NULL) {
+		kfree(wq->wq_name);
+		kfree(wq);
+		return NULL;
+	}
+	wq->wq_flushsem = sem_create(wq->wq_name, 0);
+	wq->wq_flushlock = lock_create(wq->wq_name);
+	if (wq->wq_flushsem == NULL || wq->wq_flushlock == NULL) {
+		wq_free(wq, 0);
+		return NULL;
+	}
+
+	for (ninit=0; ninit<wq->wq_ncpus; ninit++) {
+		wc = &wq->wq_cpus[ninit];
+		wc->wc_wq = wq;
+		wc->wc_cpunum = ninit;
+		wc->wc_worker = NULL;
+		work_init(&wc->wc_barrier, wq_barrier, wq->wq_flushsem, 0);
+		spinlock_init(&wc->wc_lock);
+		wc->wc_head = wc->wc_tail = NULL;
+		wc->wc_running = NULL;
+		wc->wc_exiting = false;
+		wc->wc_exited = false;
+		wc->wc_nqueued = 0;
+		wc->wc_nran = 0;
+		wc->wc_ncancelled = 0;
+		wc->wc_latency = 0;
+		wc->wc_maxlatency = 0;
+		wc->wc_wchan = wchan_create(wq->wq_name);
+		wc->wc_donechan = wchan_create(wq->wq_name);
+		if (wc->wc_wchan == NULL || wc->wc_donechan == NULL) {
+			wq_free(wq, ninit + 1);
+			return NULL;
+		}
+	}
+
+	for (started=0; started<wq->wq_ncpus; started++) {
+		wc = &wq->wq_cpus[started];
+		snprintf(namebuf, sizeof(namebuf), "%s/%u", name, started);
+		result = thread_fork_oncpu(namebuf, kproc, started,
+					   wq_worker, wc, 0);
+		if (result) {
+			wq_stopworkers(wq, started);
+			wq_free(wq, wq->wq_ncpus);
+			return NULL;
+		}
+	}
+
+	return wq;
+}
+
+void
+workqueue_destroy(struct workqueue *wq)
+{
+	KASSERT(wq != NULL);
+	KASSERT(wq != system_wq);
+
+	wq_stopworkers(wq, wq->wq_ncpus);
+	wq_free(wq, wq->wq_ncpus);
+}
+
+bool
+workqueue_queue_on(struct workqueue *wq, unsigned cpunum, struct work *w)
+{
+	struct wq_cpu *wc;
+
+	KASSERT(cpunum < wq->wq_ncpus);
+
+	/*
+	 * Claim the item first, so two cpus queueing it at once can't
+	 * both put it on a list.
+	 */
+	if (spinlock_data_testandset(&w->w_pending) != 0) {
+		return false;
+	}
+
+	wc = &wq->wq_cpus[cpunum];
+	spinlock_acquire(&wc->wc_lock);
+	KASSERT(!wc->wc_exiting);
+	w->w_cpu = wc;
+	w->w_queuedat = gettime_usec();
+	wq_cpu_append(wc, w);
+	wc->wc_nqueued++;
+	wchan_wakeone(wc->wc_wchan);
+	spinlock_release(&wc->wc_lock);
+
+	return true;
+}
+
+bool
+workqueue_queue(struct workqueue *wq, struct work *w)
+{
+	return workqueue_queue_on(wq, curcpu->c_number, w);
+}
+
+bool
+workqueue_cancel(struct workqueue *wq, struct work *w)
+{
+	struct wq_cpu *wc;
+
+	KASSERT(curthread->t_in_interrupt == false);
+
+	wc = w->w_cpu;
+	if (wc == NULL) {
+		/* never queued */
+		return false;
+	}
+	KASSERT(wc->wc_wq == wq);
+	KASSERT(curthread != wc->wc_worker);
+
+	spinlock_acquire(&wc->wc_lock);
+	if (w->w_onlist) {
+		wq_cpu_remove(wc, w);
+		spinlock_data_set(&w->w_pending, 0);
+		wc->wc_ncancelled++;
+		spinlock_release(&wc->wc_lock);
+		return true;
+	}
+	while (wc->wc_running == w) {
+		wq_cpu_waitdone(wc);
+	}
+	spinlock_release(&wc->wc_lock);
+	return false;
+}
+
+/*
+ * Flush: put a barrier item at the end of every cpu's queue and wait
+ * for all of them to run. Each cpu runs its items in order, so once
+ * its barrier has run, everything queued there before it has too.
+ */
+void
+workqueue_flush(struct workqueue *wq)
+{
+	unsigned i;
+	bool queued;
+
+	KASSERT(curthread->t_in_interrupt == false);
+
+	lock_acquire(wq->wq_flushlock);
+	for (i=0; i<wq->wq_ncpus; i++) {
+		KASSERT(curthread != wq->wq_cpus[i].wc_worker);
+		queued = workqueue_queue_on(wq, i, &wq->wq_cpus[i].wc_barrier);
+		KASSERT(queued);
+	}
+	for (i=0; i<wq->wq_ncpus; i++) {
+		P(wq->wq_flushsem);
+	}
+	lock_release(wq->wq_flushlock);
+}
+
+void
+workqueue_printstats(struct workqueue *wq)
+{
+	struct wq_cpu *wc;
+	unsigned i, nqueued, nran, ncancelled;
+	uint32_t total, maxlat;
+
+	kprintf("Workqueue %s (latency in usec):\n", wq->wq_name);
+	kprintf("%4s %9s %9s %9s %9s %9s\n", "cpu", "queued", "ran",
+		"cancelled", "avg lat", "max lat");
+	for (i=0; i<wq->wq_ncpus; i++) {
+		wc = &wq->wq_cpus[i];
+
+		spinlock_acquire(&wc->wc_lock);
+		nqueued = wc->wc_nqueued;
+		nran = wc->wc_nran;
+		ncancelled = wc->wc_ncancelled;
+		/* stay in 32 bits so we don't need a 64-bit divide */
+		total = wc->wc_latency > 0xffffffff ?
+			0xffffffff : wc->wc_latency;
+		maxlat = wc->wc_maxlatency;
+		spinlock_release(&wc->wc_lock);
+
+		kprintf("%4u %9u %9u %9u %9u %9u\n", i, nqueued, nran,
+			ncancelled, nran > 0 ? total / nran : 0, maxlat);
+	}
+}
+
+void
+workqueue_bootstrap(void)
+{
+	system_wq = workqueue_create("syswq");
+	if (system_wq == NULL) {
+		panic("workqueue_bootstrap: Out of memory\n");
+	}
+}
@@ -39,6 +39,7 @@
 #include <lib.h>
 #include <array.h>
 #include <synch.h>
+#include <epoch.h>
 #include <vfs.h>
 #include <fs.h>
 #include <vnode.h>
@@ -85,7 +86,17 @@ struct knowndev {
 DECLARRAY(knowndev);
 DEFARRAY(knowndev, /*no inline*/);
 
-static struct knowndevarray *knowndevs;
+/*
+ * The table of known devices.
+ *
+ * Changes to the table (and to kd_fs) are made under vfs_biglock, so
+ * code holding it can read the table directly. Adding a device
+ * replaces the whole array with an updated copy, and the old copy is
+ * freed through epoch_call, so code that only needs to look at the
+ * table can do so inside epoch_enter/epoch_exit without the lock.
+ * The knowndev structures themselves are never freed.
+ */
+static struct knowndevarray *volatile knowndevs;
 
 /* The big lock for all FS ops. Remove for filesystem assignment. */
 static struct lock *vfs_biglock;
@@ -259,13 +270,17 @@ vfs_getdevname(struct fs *fs)
 	struct knowndev *kd;
 	unsigned i, num;
 
-	KASSERT(fs != NULL);
+	struct knowndevarray *devs;
+	const char *name = NULL;
 
-	KASSERT(vfs_biglock_do_i_hold());
+	KASSERT(fs != NULL);
 
-	num = knowndevarray_num(knowndevs);
+	/* No lock needed; see above. */
+	epoch_enter();
+	devs = knowndevs;
+	num = knowndevarray_num(devs);
 	for (i=0; i<num; i++) {
-		kd = knowndevarray_get(knowndevs, i);
+		kd = knowndevarray_get(devs, i);
 
 		if (kd->kd_fs == fs) {
 			/*
@@ -274,11 +289,13 @@ vfs_getdevname(struct fs *fs)
 			 * the fs cannot go away, and the device can't
 			 * go away until the fs goes away.
 			 */
-			return kd->kd_name;
+			name = kd->kd_name;
+			break;
 		}
 	}
+	epoch_exit();
 
-	return NULL;
+	return name;
 }
 
 /*
@@ -360,6 +377,58 @@ badnames(const char *n1, const char *n2, const char *n3)
 	return 0;
 }
 
+/*
+ * Free an old copy of the knowndevs array. Called via epoch_call once
+ * no lockless reader can still be looking at it.
+ */
+static
+void
+knowndevs_free(void *arg)
+{
+	struct knowndevarray *old = arg;
+
+	knowndevarray_setsize(old, 0);
+	knowndevarray_destroy(old);
+}
+
+/*
+ * Add KD to the table: copy the array with KD on the end, publish the
+ * copy, and retire the old one.
+ */
+static
+int
+knowndevs_add(struct knowndev *kd, unsigned *index_ret)
+{
+	struct knowndevarray *old, *new;
+	unsigned i, num;
+	int result;
+
+	KASSERT(vfs_biglock_do_i_hold());
+
+	old = knowndevs;
+	num = knowndevarray_num(old);
+
+	new = knowndevarray_create();
+	if (new == NULL) {
+		return ENOMEM;
+	}
+	result = knowndevarray_setsize(new, num + 1);
+	if (result) {
+		knowndevarray_destroy(new);
+		return result;
+	}
+	for (i=0; i<num; i++) {
+		knowndevarray_set(new, i, knowndevarray_get(old, i));
+	}
+	knowndevarray_set(new, num, kd);
+
+	knowndevs = new;
+	epoch_call(knowndevs_free, old);
+
+	*index_ret = num;
+	return 0;
+}
+
 /*
  * Add a new device to the VFS layer's device table.
  *
@@ -416,7 +485,7 @@ vfs_doadd(const char *dname, int mountable, struct device *dev, struct fs *fs)
 		return EEXIST;
 	}
 
-	result = knowndevarray_add(knowndevs, kd, &index);
+	result = knowndevs_add(kd, &index);
 
 	if (result == 0 && dev != NULL) {
 		/* use index+1 as the device number, so 0 is reserved */
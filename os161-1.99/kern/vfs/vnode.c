@@ -33,6 +33,7 @@
 #include <types.h>
 #include <kern/errno.h>
 #include <lib.h>
+#include <atomic.h>
 #include <synch.h>
 #include <vfs.h>
 #include <vnode.h>
@@ -77,44 +78,56 @@ vnode_cleanup(struct vnode *vn)
 /*
  * Increment refcount.
  * Called by VOP_INCREF.
+ *
+ * This is atomic and doesn't need the biglock: the caller either
+ * holds a reference already, so the count can't be on its way to
+ * zero, or is the filesystem finding the vnode in its table, which
+ * it does under the biglock that VOP_RECLAIM also takes.
  */
 void
 vnode_incref(struct vnode *vn)
 {
 	KASSERT(vn != NULL);
 
-	vfs_biglock_acquire();
-
-	vn->vn_refcount++;
-
-	vfs_biglock_release();
+	atomic_inc(&vn->vn_refcount);
 }
 
 /*
  * Decrement refcount.
  * Called by VOP_DECREF.
  * Calls VOP_RECLAIM if the refcount hits zero.
+ *
+ * Dropping a reference that isn't the last is a compare-and-swap
+ * without the biglock. Dropping what looks like the last one goes to
+ * VOP_RECLAIM under the biglock as before; since someone may have
+ * picked up a new reference in the meantime, the filesystem checks
+ * the count again and, if it's no longer 1, just decrements it.
  */
 void
 vnode_decref(struct vnode *vn)
 {
+	unsigned count, seen;
 	int result;
 
 	KASSERT(vn != NULL);
 
+	count = atomic_load(&vn->vn_refcount);
+	while (count > 1) {
+		seen = atomic_cas(&vn->vn_refcount, count, count - 1);
+		if (seen == count) {
+			return;
+		}
+		count = seen;
+	}
+	KASSERT(count == 1);
+
 	vfs_biglock_acquire();
 
-	KASSERT(vn->vn_refcount>0);
-	if (vn->vn_refcount>1) {
-		vn->vn_refcount--;
-	}
-	else {
-		result = VOP_RECLAIM(vn);
-		if (result != 0 && result != EBUSY) {
-			// XXX: lame.
-			kprintf("vfs: Warning: VOP_RECLAIM: %s\n",
-				strerror(result));
-		}
+	result = VOP_RECLAIM(vn);
+	if (result != 0 && result != EBUSY) {
+		// XXX: lame.
+		kprintf("vfs: Warning: VOP_RECLAIM: %s\n",
+			strerror(result));
 	}
 
 	vfs_biglock_release();
@@ -173,6 +186,8 @@ vnode_decopen(struct vnode *vn)
 void
 vnode_check(struct vnode *v, const char *opstr)
 {
+	int refcount;
+
 	vfs_biglock_acquire();
 
 	if (v == NULL) {
@@ -202,16 +217,17 @@ vnode_check(struct vnode *v, const char *opstr)
 		panic("vnode_check: vop_%s: deadbeef fs pointer\n", opstr);
 	}
 
-	if (v->vn_refcount < 0) {
+	refcount = (int)atomic_load(&v->vn_refcount);
+	if (refcount < 0) {
 		panic("vnode_check: vop_%s: negative refcount %d\n", opstr,
-		      v->vn_refcount);
+		      refcount);
 	}
-	else if (v->vn_refcount == 0 && strcmp(opstr, "reclaim")) {
+	else if (refcount == 0 && strcmp(opstr, "reclaim")) {
 		panic("vnode_check: vop_%s: zero refcount\n", opstr);
 	}
-	else if (v->vn_refcount > 0x100000) {
+	else if (refcount > 0x100000) {
 		kprintf("vnode_check: vop_%s: warning: large refcount %d\n", 
-			opstr, v->vn_refcount);
+			opstr, refcount);
 	}
 
 	if (v->vn_opencount < 0) {